@@ -0,0 +1,63 @@
+const ONE_SECOND_IN_MS = 1000;
+const LCD_WIDTH = 128;
+const LCD_HEIGHT = 64;
+const LCD_BYTES_PER_ROW = LCD_WIDTH / 8;
+
+const ELM_CANVAS_LCD = document.getElementById('lcd');
+const ELM_DIV_ERROR_MESSAGE = document.getElementById('error');
+
+const context = ELM_CANVAS_LCD.getContext('2d');
+const image = context.createImageData(LCD_WIDTH, LCD_HEIGHT);
+
+// The sequence number of the frame on the canvas, the server holds the request until the next one.
+let sequence = 0;
+
+/**
+ * Draw a run-length encoded frame: (count, byte) pairs, 16 bytes per row, most significant bit left, 1 is lit.
+ */
+function drawFrame(rle) {
+    let offset = 0;
+    for (let i = 0; i + 1 < rle.length; i += 2) {
+        for (let run = 0; run < rle[i]; run++, offset++) {
+            const y = Math.floor(offset / LCD_BYTES_PER_ROW);
+            const x = (offset % LCD_BYTES_PER_ROW) * 8;
+            for (let bit = 0; bit < 8; bit++) {
+                const value = (rle[i + 1] << bit) & 0x80 ? 255 : 0;
+                const pixel = (y * LCD_WIDTH + x + bit) * 4;
+                image.data[pixel] = value;
+                image.data[pixel + 1] = value;
+                image.data[pixel + 2] = value;
+                image.data[pixel + 3] = 255;
+            }
+        }
+    }
+    context.putImageData(image, 0, 0);
+}
+
+function pollFrame() {
+    fetch('/api/lcd?format=rle&after=' + sequence, {
+        cache: 'no-store'
+    }).then(response => {
+        if (!response.ok) {
+            throw new Error('HTTP ' + response.status);
+        }
+        ELM_DIV_ERROR_MESSAGE.style.display = 'none';
+        sequence = Number(response.headers.get('X-Frame-Sequence')) || sequence;
+        // 204: no new frame yet, ask again.
+        if (response.status === 204) {
+            return null;
+        }
+        return response.arrayBuffer();
+    }).then(buffer => {
+        if (buffer) {
+            drawFrame(new Uint8Array(buffer));
+        }
+        pollFrame();
+    }).catch(() => {
+        ELM_DIV_ERROR_MESSAGE.textContent = "Lost connection to the display, retrying...";
+        ELM_DIV_ERROR_MESSAGE.style.display = 'block';
+        setTimeout(pollFrame, ONE_SECOND_IN_MS);
+    });
+}
+
+pollFrame();
@@ -1,5 +1,6 @@
 
 const TEN_SECONDS_IN_MS = 10000;
+const ONE_SECOND_IN_MS = 1000;
 
 const ELM_UL_NETWORK_LIST = document.getElementById('networkList');
 const ELM_DIV_NETWORK_DETAILS = document.getElementById('networkDetails');
@@ -61,10 +62,15 @@ function loadNetworks() {
     })
         .then(response => response.json())
         .then(data => {
+            // The first scan is still running, ask again shortly.
+            if (data.scanning && data.networks.length === 0) {
+                setTimeout(loadNetworks, ONE_SECOND_IN_MS);
+                return;
+            }
             ELM_DIV_SPINNER.style.display = 'none';
             ELM_DIV_ERROR_MESSAGE.style.display = 'none';
             ELM_UL_NETWORK_LIST.innerHTML = '';
-            data.forEach(network => {
+            data.networks.forEach(network => {
                 const listItem = document.createElement('li');
                 listItem.textContent = `${network.ssid} ${network.open ? '(Open)' : ''} - rssi ${network.rssi}`;
                 listItem.onclick = () => selectNetwork(network);
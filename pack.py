@@ -15,11 +15,15 @@
 #
 #   3. In your application code, you can access files using this function:
 #      const char *mg_unpack(const char *file_name, size_t *size);
+#      or, for the whole entry including its ETag (a content hash), MIME type and gzipped copy:
+#      const struct packed_file *mg_unpack_file(const char *file_name);
+#   Lookups are a binary search, the table is sorted when it is generated.
 #
 #   4. Build your app with fs.c:
 #      cc -o my_app my_app.c fs.c
 
 import errno
+import hashlib
 import sys
 import os
 import stat
@@ -32,18 +36,45 @@ code = """static int scmp(const char *a, const char *b) {
 const char *mg_unlist(size_t no) {
   return packed_files[no].name;
 }
-const char *mg_unpack(const char *name, size_t *size, time_t *mtime) {
-  const struct packed_file *p;
-  for (p = packed_files; p->name != NULL; p++) {
-    if (scmp(p->name, name) != 0) continue;
-    if (size != NULL) *size = p->size - 1;
-    if (mtime != NULL) *mtime = p->mtime;
-    return (const char *) p->data;
+const struct packed_file *mg_unpack_file(const char *name) {
+  /* packed_files is sorted by name. */
+  size_t low = 0, high = PACKED_FILES_COUNT;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    int cmp = scmp(packed_files[mid].name, name);
+    if (cmp == 0) return &packed_files[mid];
+    if (cmp < 0) low = mid + 1; else high = mid;
   }
   return NULL;
 }
+const char *mg_unpack(const char *name, size_t *size, time_t *mtime) {
+  const struct packed_file *p = mg_unpack_file(name);
+  if (p == NULL) return NULL;
+  if (size != NULL) *size = p->size - 1;
+  if (mtime != NULL) *mtime = p->mtime;
+  return (const char *) p->data;
+}
 """
 
+# Content types by extension, application/octet-stream for anything else.
+mime_types = {
+    ".css": "text/css",
+    ".html": "text/html",
+    ".ico": "image/x-icon",
+    ".jpg": "image/jpeg",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+    ".txt": "text/plain",
+}
+
+def mime_type(name):
+    # The type of a gzipped copy is the type of the original.
+    if name.endswith(".gz"):
+        name = name[:-3]
+    return mime_types.get(os.path.splitext(name)[1], "application/octet-stream")
+
 def main(argv):
     i = 0
     strip_prefix = ""
@@ -55,12 +86,15 @@ def main(argv):
     print("#if defined(__cplusplus)\nextern \"C\" {\n#endif")
     print("const char *mg_unlist(size_t no);")
     print("const char *mg_unpack(const char *, size_t *, time_t *);")
+    print("struct packed_file;")
+    print("const struct packed_file *mg_unpack_file(const char *);")
     print("#if defined(__cplusplus)\n}\n#endif\n\n", end='')
 
     while i < len(argv):
         if argv[i] == "-s":
             strip_prefix = argv[i + 1]
             i += 2
+            continue
         elif argv[i] == "-h" or argv[i] == "--help":
             sys.stderr.write("Usage: %s[-s STRIP_PREFIX] files...\n" % argv[0])
             sys.exit(os.EX_USAGE)
@@ -84,31 +118,44 @@ def main(argv):
 
         i += 1
 
+    # The table is sorted by name for the binary search in mg_unpack_file().
+    entries = []
+    i = 0
+    while i < len(argv):
+        if argv[i] == "-s":
+            i += 2
+            continue
+        name = argv[i]
+        if name.startswith(strip_prefix):
+            name = name[len(strip_prefix):]
+        entries.append(("/" + name, argv[i], i + 1))
+        i += 1
+    entries.sort(key=lambda entry: entry[0].encode())
+    index = {entry[0]: position for position, entry in enumerate(entries)}
+
+    print("")
+    print("#define PACKED_FILES_COUNT %d" % len(entries))
     print("")
     print("static const struct packed_file {")
     print("  const char *name;")
     print("  const unsigned char *data;")
     print("  size_t size;")
     print("  time_t mtime;")
+    print("  const char *etag;")
+    print("  const char *mime;")
+    print("  const struct packed_file *gzip;")
     print("} packed_files[] = {")
 
-    i = 0
-    while i < len(argv):
-        if argv[i] == "-s":
-            i += 1
-            continue
-        st = os.stat(argv[i])
-        name = argv[i]
-        n = len(strip_prefix)
-        if argv[i] == "-s":
-            i += 1
-            continue
-        if name.startswith(strip_prefix):
-            name = name[n:]
-        print("  {\"/%s\", v%d, sizeof(v%d), %lu}," % (name, i + 1, i + 1, st.st_mtime))
-        i += 1
+    for name, path, var in entries:
+        st = os.stat(path)
+        # A strong ETag: changes when, and only when, the content changes.
+        with open(path, "rb") as fp:
+            etag = hashlib.sha1(fp.read()).hexdigest()[:16]
+        gzip = "&packed_files[%d]" % index[name + ".gz"] if name + ".gz" in index else "NULL"
+        print("  {\"%s\", v%d, sizeof(v%d), %lu, \"\\\"%s\\\"\", \"%s\", %s}," %
+              (name, var, var, st.st_mtime, etag, mime_type(name), gzip))
 
-    print("  {NULL, NULL, 0, 0}")
+    print("  {NULL, NULL, 0, 0, NULL, NULL, NULL}")
     print("};\n")
     print(code, end='')
 
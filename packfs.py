@@ -1,7 +1,8 @@
 #this script will be run by platformio.ini from its native directory
 import os, sys, gzip, shutil
 
-compress = False
+# Also pack a gzipped copy of every file that gets smaller, served to clients that accept gzip.
+compress = True
 
 if os.path.isdir("pack.tmp"):
     shutil.rmtree('pack.tmp')
@@ -11,17 +12,24 @@ try:
     # now gzip the stuff except zones.csv since this file is not served by mongoose but directly accessed:
     for file in os.listdir("data"):
         filename = os.fsdecode(file)
+        # Keep the modification time, it is the Last-Modified of the file.
+        shutil.copy2('data/' + filename, 'pack.tmp/data/' + filename)
+        filelist.append('data/' + filename)
         if not compress:
-            shutil.copy('data/' + filename, 'pack.tmp/data/' + filename)
-            filelist.append('data/' + filename)
             continue
-        else:
-            with open('data/' + filename, 'rb') as f_in, gzip.open('pack.tmp/data/' + filename + '.gz', 'wb') as f_out:
-                f_out.writelines(f_in)
-            filelist.append('data/' + filename + '.gz')
+        with open('data/' + filename, 'rb') as f_in:
+            content = f_in.read()
+        # mtime=0 keeps the gzip output, and so its ETag, the same for the same content.
+        compressed = gzip.compress(content, compresslevel=9, mtime=0)
+        if len(compressed) >= len(content):
             continue
+        with open('pack.tmp/data/' + filename + '.gz', 'wb') as f_out:
+            f_out.write(compressed)
+        shutil.copystat('data/' + filename, 'pack.tmp/data/' + filename + '.gz')
+        filelist.append('data/' + filename + '.gz')
     os.chdir('pack.tmp')
-    cmdstring = 'python ../pack.py ' + ' '.join(filelist)
+    # Strip "data/", so the files are found by their URL path.
+    cmdstring = 'python ../pack.py -s data/ ' + ' '.join(filelist)
     os.system(cmdstring + '>../src/packed_fs.c')
     os.chdir('..')
 except Exception as e:
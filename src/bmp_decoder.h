@@ -0,0 +1,140 @@
+#ifndef BMP_DECODER_H
+#define BMP_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Widest supported row, in bytes (512 pixels at 1 bit per pixel).
+#define BMP_MAX_ROW_BYTES 64
+
+enum BmpStatus {
+    BMP_OK,
+    BMP_SHORT_READ,
+    BMP_NOT_A_BITMAP,
+    BMP_UNSUPPORTED
+};
+
+/**
+ * The properties of a 1 bit per pixel BMP, taken from the BITMAPFILEHEADER and BITMAPINFOHEADER.
+ */
+struct BmpInfo {
+    int32_t width;
+    int32_t height;
+    // Rows are stored top to bottom (negative biHeight) instead of bottom to top.
+    bool topDown;
+    // Bytes per row in the file, including the padding to 4 bytes.
+    uint32_t rowStride;
+};
+
+namespace bmp {
+    inline uint16_t readLe16(const uint8_t *data) {
+        return static_cast<uint16_t>(data[0] | data[1] << 8);
+    }
+
+    inline uint32_t readLe32(const uint8_t *data) {
+        return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+               static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+    }
+
+    /**
+     * Read exactly length bytes. The source handles short reads and timeouts itself
+     * (like Stream::readBytes()), so fewer bytes means the data is not coming.
+     */
+    template<typename Source>
+    bool readFully(Source &source, uint8_t *buffer, const size_t length) {
+        return source.readBytes(buffer, length) == length;
+    }
+
+    template<typename Source>
+    bool skip(Source &source, size_t length) {
+        uint8_t scratch[16];
+        while (length > 0) {
+            const size_t chunk = length < sizeof(scratch) ? length : sizeof(scratch);
+            if (!readFully(source, scratch, chunk)) {
+                return false;
+            }
+            length -= chunk;
+        }
+        return true;
+    }
+}
+
+/**
+ * Read the BMP headers, and skip the palette to the pixel data (bfOffBits).
+ * Only uncompressed 1 bit per pixel images are supported.
+ *
+ * @param source Any stream with readBytes(uint8_t *, size_t), like WiFiClient.
+ * @param info Receives the image properties.
+ */
+template<typename Source>
+BmpStatus readBmpHeader(Source &source, BmpInfo &info) {
+    // BITMAPFILEHEADER (14 bytes) and the size of the info header.
+    uint8_t header[40];
+    if (!bmp::readFully(source, header, 18)) {
+        return BMP_SHORT_READ;
+    }
+    if (header[0] != 'B' || header[1] != 'M') {
+        return BMP_NOT_A_BITMAP;
+    }
+    const uint32_t pixelOffset = bmp::readLe32(header + 10);
+    const uint32_t infoSize = bmp::readLe32(header + 14);
+    if (infoSize < 40) {
+        // BITMAPCOREHEADER and other old formats.
+        return BMP_UNSUPPORTED;
+    }
+
+    // The rest of the BITMAPINFOHEADER, newer versions only add fields we do not need.
+    if (!bmp::readFully(source, header, 36) || !bmp::skip(source, infoSize - 40)) {
+        return BMP_SHORT_READ;
+    }
+    const auto width = static_cast<int32_t>(bmp::readLe32(header));
+    const auto height = static_cast<int32_t>(bmp::readLe32(header + 4));
+    const uint16_t planes = bmp::readLe16(header + 8);
+    const uint16_t bitCount = bmp::readLe16(header + 10);
+    const uint32_t compression = bmp::readLe32(header + 12);
+
+    // INT32_MIN has no positive counterpart.
+    if (planes != 1 || bitCount != 1 || compression != 0 || width <= 0 || height == 0 || height == INT32_MIN) {
+        return BMP_UNSUPPORTED;
+    }
+
+    info.width = width;
+    info.height = height < 0 ? -height : height;
+    info.topDown = height < 0;
+    info.rowStride = (static_cast<uint32_t>(width) + 31) / 32 * 4;
+    if (info.rowStride > BMP_MAX_ROW_BYTES) {
+        return BMP_UNSUPPORTED;
+    }
+
+    const uint32_t consumed = 14 + infoSize;
+    if (pixelOffset < consumed) {
+        return BMP_NOT_A_BITMAP;
+    }
+
+    // The palette is not used: the SmartEVSE sets the bits of the content, whatever colors it names.
+    return bmp::skip(source, pixelOffset - consumed) ? BMP_OK : BMP_SHORT_READ;
+}
+
+/**
+ * Decode the pixel data one row at a time, after readBmpHeader().
+ *
+ * The row handed to onRow is packed most significant bit first, a set bit is foreground,
+ * whatever the palette says. Rows are reported with their position from the top, whatever
+ * the order in the file.
+ *
+ * @param onRow Called as onRow(int y, const uint8_t *row) for every row.
+ */
+template<typename Source, typename RowHandler>
+BmpStatus readBmpRows(Source &source, const BmpInfo &info, RowHandler onRow) {
+    uint8_t row[BMP_MAX_ROW_BYTES];
+
+    for (int32_t i = 0; i < info.height; ++i) {
+        if (!bmp::readFully(source, row, info.rowStride)) {
+            return BMP_SHORT_READ;
+        }
+        onRow(info.topDown ? i : info.height - 1 - i, static_cast<const uint8_t *>(row));
+    }
+    return BMP_OK;
+}
+
+#endif // BMP_DECODER_H
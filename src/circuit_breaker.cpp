@@ -0,0 +1,69 @@
+#include "circuit_breaker.h"
+
+#include "log.h"
+
+CircuitBreaker::CircuitBreaker(hal::Clock &clock, const uint32_t threshold, const uint32_t baseBackoffMs,
+                               const uint32_t maxBackoffMs, const uint32_t seed)
+    : clock(clock), threshold(threshold), baseBackoffMs(baseBackoffMs), maxBackoffMs(maxBackoffMs),
+      random(seed != 0 ? seed : 1), backoffs(0), state(BREAKER_CLOSED), failures(0), retryAt(0) {
+}
+
+uint32_t CircuitBreaker::nextRandom() {
+    // xorshift32, enough to spread the retries.
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
+
+bool CircuitBreaker::allow() {
+    if (state.load() != BREAKER_OPEN) {
+        return true;
+    }
+    if (static_cast<int32_t>(clock.millis() - retryAt.load()) < 0) {
+        return false;
+    }
+    state.store(BREAKER_HALF_OPEN);
+    return true;
+}
+
+void CircuitBreaker::success() {
+    if (state.load() != BREAKER_CLOSED) {
+        LOG_PRINTF("==== CircuitBreaker closed after %u failures\n", static_cast<unsigned>(failures.load()));
+    }
+    state.store(BREAKER_CLOSED);
+    failures.store(0);
+    backoffs = 0;
+}
+
+void CircuitBreaker::failure() {
+    const uint32_t failed = failures.load() + 1;
+    failures.store(failed);
+    if (state.load() == BREAKER_CLOSED && failed < threshold) {
+        return;
+    }
+
+    // Equal jitter: half of the backoff, plus a random part of the other half.
+    uint32_t backoff = maxBackoffMs;
+    if (backoffs < 16 && baseBackoffMs << backoffs < maxBackoffMs) {
+        backoff = baseBackoffMs << backoffs;
+    }
+    backoffs++;
+    const uint32_t delay = backoff / 2 + nextRandom() % (backoff / 2 + 1);
+    retryAt.store(clock.millis() + delay);
+    state.store(BREAKER_OPEN);
+    LOG_PRINTF("==== CircuitBreaker open after %u failures, retry in %u ms\n", static_cast<unsigned>(failed),
+               static_cast<unsigned>(delay));
+}
+
+void CircuitBreaker::reset() {
+    state.store(BREAKER_CLOSED);
+    failures.store(0);
+    backoffs = 0;
+}
+
+BreakerStatus CircuitBreaker::getStatus() const {
+    const BreakerState current = getState();
+    const int32_t retryIn = static_cast<int32_t>(retryAt.load() - clock.millis());
+    return {current, failures.load(), current == BREAKER_OPEN && retryIn > 0 ? static_cast<uint32_t>(retryIn) : 0};
+}
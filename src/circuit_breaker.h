@@ -0,0 +1,79 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "hal.h"
+
+enum BreakerState {
+    // Requests go through.
+    BREAKER_CLOSED,
+    // Too many requests failed, wait for the backoff.
+    BREAKER_OPEN,
+    // The backoff is over, the next request decides.
+    BREAKER_HALF_OPEN
+};
+
+/**
+ * What the breaker is doing, readable from any task.
+ */
+struct BreakerStatus {
+    BreakerState state;
+    // Failures in a row.
+    uint32_t failures;
+    // Until the next attempt, 0 unless open.
+    uint32_t retryInMs;
+};
+
+/**
+ * Stops requests to an endpoint that does not answer, so the network task does not spend its
+ * time waiting out timeouts.
+ *
+ * After threshold failures in a row the breaker opens for a backoff that doubles on every failed
+ * retry, up to maxBackoffMs, with jitter so units that went down together don't retry together.
+ * The first success closes it. Runs on the network task, except getStatus().
+ */
+class CircuitBreaker {
+public:
+    CircuitBreaker(hal::Clock &clock, uint32_t threshold, uint32_t baseBackoffMs, uint32_t maxBackoffMs,
+                   uint32_t seed);
+
+    /**
+     * @return True if a request may go out now. When the backoff is over this moves to half-open,
+     * the caller probes and reports the result.
+     */
+    bool allow();
+
+    void success();
+
+    void failure();
+
+    /**
+     * Close the breaker and forget the failures, for another host.
+     */
+    void reset();
+
+    BreakerState getState() const {
+        return static_cast<BreakerState>(state.load());
+    }
+
+    BreakerStatus getStatus() const;
+
+private:
+    hal::Clock &clock;
+    const uint32_t threshold;
+    const uint32_t baseBackoffMs;
+    const uint32_t maxBackoffMs;
+    uint32_t random;
+    // Backoffs in a row, the next one is twice as long.
+    uint32_t backoffs;
+
+    std::atomic<int> state;
+    std::atomic<uint32_t> failures;
+    std::atomic<uint32_t> retryAt;
+
+    uint32_t nextRandom();
+};
+
+#endif // CIRCUIT_BREAKER_H
@@ -0,0 +1,107 @@
+#include "event_stream.h"
+
+#include <ArduinoJson.h>
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+
+static const char RESPONSE_HEADER[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "\r\n"
+        // Reconnect after 3 s when the connection drops.
+        "retry: 3000\n\n";
+
+static const char PING[] = ": ping\n\n";
+
+size_t formatStatusEvent(const EvseSnapshot &snapshot, const bool wifiConnected, char *out, const size_t size,
+                         ArduinoJson::Allocator *allocator) {
+    JsonDocument doc(allocator);
+    doc["wifi"] = wifiConnected;
+    doc["connected"] = snapshot.connected;
+    doc["mode"] = modeName(snapshot.mode);
+    doc["evseState"] = snapshot.evseState;
+    doc["chargeCurrent"] = snapshot.chargeCurrent;
+    doc["gridCurrent"] = snapshot.gridCurrent;
+    doc["error"] = errorMessage(snapshot.error);
+
+    static const char PREFIX[] = "event: status\ndata: ";
+    const size_t prefixLength = sizeof(PREFIX) - 1;
+    if (size < prefixLength + 3) {
+        return 0;
+    }
+    memcpy(out, PREFIX, prefixLength);
+    size_t length = prefixLength + serializeJson(doc, out + prefixLength, size - prefixLength - 2);
+    out[length++] = '\n';
+    out[length++] = '\n';
+    out[length] = '\0';
+    return length;
+}
+
+EventStream::EventStream(const SendFunction send)
+    : send(send), pingPending(false), lastRecord(), clients(), clientCount(0) {
+}
+
+bool EventStream::publish(const EvseSnapshot &snapshot, const bool wifiConnected) {
+    EventRecord &record = records.back();
+    record.length = formatStatusEvent(snapshot, wifiConnected, record.data, sizeof(record.data), &arena);
+    if (record.length == lastRecord.length && memcmp(record.data, lastRecord.data, record.length) == 0) {
+        return false;
+    }
+    lastRecord = record;
+    records.publish();
+    return true;
+}
+
+bool EventStream::subscribe(const int fd) {
+    if (clientCount >= EVENT_STREAM_MAX_CLIENTS) {
+        LOG_PRINTF("==== EventStream::subscribe() too many clients\n");
+        return false;
+    }
+    if (send(fd, RESPONSE_HEADER, sizeof(RESPONSE_HEADER) - 1) < 0) {
+        return false;
+    }
+    clients[clientCount++] = fd;
+    LOG_PRINTF("==== EventStream::subscribe() clients: %u\n", static_cast<unsigned>(clientCount));
+
+    // The newest record. If it was not sent yet, the other clients get it as well.
+    if (records.consume()) {
+        sendToAll(records.front().data, records.front().length);
+    } else if (records.front().length > 0 && send(fd, records.front().data, records.front().length) < 0) {
+        unsubscribe(fd);
+    }
+    return true;
+}
+
+void EventStream::unsubscribe(const int fd) {
+    for (size_t i = 0; i < clientCount; i++) {
+        if (clients[i] == fd) {
+            clients[i] = clients[--clientCount];
+            LOG_PRINTF("==== EventStream::unsubscribe() clients: %u\n", static_cast<unsigned>(clientCount));
+            return;
+        }
+    }
+}
+
+void EventStream::flush() {
+    if (records.consume()) {
+        sendToAll(records.front().data, records.front().length);
+    }
+    if (pingPending.exchange(false)) {
+        sendToAll(PING, sizeof(PING) - 1);
+    }
+}
+
+void EventStream::sendToAll(const char *data, const size_t length) {
+    for (size_t i = 0; i < clientCount;) {
+        if (send(clients[i], data, length) < 0) {
+            // The send function has the web server close the socket, unsubscribe() then finds nothing.
+            clients[i] = clients[--clientCount];
+        } else {
+            i++;
+        }
+    }
+}
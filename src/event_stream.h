@@ -0,0 +1,116 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "evse_state.h"
+#include "json_arena.h"
+#include "triple_buffer.h"
+
+// Web clients following the event stream at the same time.
+#define EVENT_STREAM_MAX_CLIENTS 4
+#define EVENT_RECORD_LEN 320
+// Room for the document of a status event.
+#define EVENT_STREAM_JSON_ARENA_SIZE 1024
+
+/**
+ * One Server-Sent Event, ready to be written to the sockets.
+ */
+struct EventRecord {
+    char data[EVENT_RECORD_LEN];
+    size_t length;
+};
+
+/**
+ * Server-Sent Events with the SmartEVSE state, for the web clients following /api/events.
+ *
+ * The UI publishes the state after every poll, a record is only sent when it changed. The
+ * sockets belong to the web server task, so subscribe(), unsubscribe() and flush() run there.
+ * They meet the UI in a triple buffer, so the UI never waits for a slow client.
+ */
+class EventStream {
+public:
+    /**
+     * Write to a client socket.
+     *
+     * @return The number of bytes written, negative if the socket failed.
+     */
+    typedef int (*SendFunction)(int fd, const char *data, size_t length);
+
+    explicit EventStream(SendFunction send);
+
+    // ---- UI ----
+
+    /**
+     * Publish the state as a "status" event.
+     *
+     * @param wifiConnected True if the display is connected to WiFi.
+     * @return True if the record differs from the previous one and needs a flush().
+     */
+    bool publish(const EvseSnapshot &snapshot, bool wifiConnected);
+
+    /**
+     * Ask for a comment line to all clients, so idle connections stay open and closed ones are noticed.
+     */
+    void ping() {
+        pingPending = true;
+    }
+
+    // ---- Web server task ----
+
+    /**
+     * Start the event stream on the socket of a request: send the response header and the latest state.
+     *
+     * @return False if there are too many clients.
+     */
+    bool subscribe(int fd);
+
+    /**
+     * Forget a client, call this when its socket is closed.
+     */
+    void unsubscribe(int fd);
+
+    /**
+     * Send the latest record, and a pending ping, to all clients. Clients that fail are dropped.
+     */
+    void flush();
+
+    size_t getClientCount() const {
+        return clientCount;
+    }
+
+    /**
+     * @return The allocations of formatted events that did not fit the arena. Safe from any task.
+     */
+    uint32_t getJsonArenaFallbacks() const {
+        return arena.getFallbacks();
+    }
+
+private:
+    SendFunction send;
+    TripleBuffer<EventRecord> records;
+    std::atomic<bool> pingPending;
+
+    // Owned by the UI.
+    EventRecord lastRecord;
+    JsonArena<EVENT_STREAM_JSON_ARENA_SIZE> arena;
+
+    // Owned by the web server task.
+    int clients[EVENT_STREAM_MAX_CLIENTS];
+    size_t clientCount;
+
+    void sendToAll(const char *data, size_t length);
+};
+
+/**
+ * Format the state as a "status" event: {"wifi":..,"connected":..,"mode":..,"evseState":..,
+ * "chargeCurrent":..,"gridCurrent":..,"error":..}.
+ *
+ * @param allocator Holds the document while it is formatted.
+ * @return The length of the record.
+ */
+size_t formatStatusEvent(const EvseSnapshot &snapshot, bool wifiConnected, char *out, size_t size,
+                         ArduinoJson::Allocator *allocator);
+
+#endif // EVENT_STREAM_H
@@ -0,0 +1,254 @@
+#include "evse_client.h"
+
+#include <ArduinoJson.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "bmp_decoder.h"
+#include "log.h"
+
+constexpr uint32_t SETTINGS_TIMEOUT = 1500;
+constexpr uint32_t LCD_TIMEOUT = 750;
+constexpr uint32_t PROBE_TIMEOUT = 300;
+
+/**
+ * The fields of /settings the display uses. The SmartEVSE sends several KB of settings,
+ * the filter keeps the rest out of the JsonDocument while it is parsed from the socket.
+ */
+static JsonDocument makeSettingsFilter() {
+    JsonDocument filter;
+    filter["mode_id"] = true;
+    filter["evse"]["state"] = true;
+    filter["settings"]["charge_current"] = true;
+    filter["phase_currents"]["TOTAL"] = true;
+    return filter;
+}
+
+/**
+ * The field of the mode change response the display uses.
+ */
+static JsonDocument makeModeFilter() {
+    JsonDocument filter;
+    filter["mode"] = true;
+    return filter;
+}
+
+void EvseClient::countResponse(const int httpResponseCode) {
+    if (metrics != nullptr) {
+        metrics->countHttpResponse(httpResponseCode);
+    }
+}
+
+void EvseClient::updateUrls(const EvseTarget &target) {
+    if (strcmp(target.host, urlTarget.host) == 0 && strcmp(target.ip, urlTarget.ip) == 0 &&
+        target.port == urlTarget.port && settingsUrl[0] != '\0') {
+        return;
+    }
+    urlTarget = target;
+    formatUrl(settingsUrl, sizeof(settingsUrl), target, "/settings");
+    formatUrl(lcdUrl, sizeof(lcdUrl), target, "/lcd");
+    formatUrl(probeUrl, sizeof(probeUrl), target, "/");
+}
+
+void EvseClient::formatUrl(char *url, const size_t size, const EvseTarget &target, const char *path) {
+    if (target.ip[0] != '\0') {
+        snprintf(url, size, "http://%s:%u%s", target.ip, static_cast<unsigned>(target.port != 0 ? target.port : 80),
+                 path);
+    } else {
+        snprintf(url, size, "http://%s.local%s", target.host, path);
+    }
+}
+
+bool EvseClient::fetchSettings(EvseSnapshot &state, const EvseTarget &target) {
+    LOG_PRINTF("==== fetchSettings() for host: \"%s\" (%s)\n", target.host, target.ip);
+    if (target.host[0] == '\0') {
+        LOG_PRINTF("==== fetchSettings() smartEvseHost is empty\n");
+        state.connected = false;
+        state.error = EVSE_ERROR_NO_HOST;
+        return false;
+    }
+
+    updateUrls(target);
+    const int httpResponseCode = http.get(settingsUrl, SETTINGS_TIMEOUT);
+    LOG_PRINTF("==== fetchSettings() httpResponseCode: %d\n", httpResponseCode);
+    countResponse(httpResponseCode);
+
+    if (httpResponseCode >= 200 && httpResponseCode < 300) {
+        state.connected = true;
+
+        // JSON parsing, straight from the response body, keeping only the fields we use.
+        static const JsonDocument filter = makeSettingsFilter();
+        JsonDocument doc(&arena);
+        DeserializationError jsonError;
+        {
+            StageTimer parseTimer(metrics, STAGE_JSON_PARSE);
+            if (settingsCache != nullptr) {
+                // Keep a copy of the complete body on the way through the parser.
+                settingsCache->begin();
+                TeeStream body(http.body(), *settingsCache);
+                jsonError = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+            } else {
+                jsonError = deserializeJson(doc, http.body(), DeserializationOption::Filter(filter));
+            }
+        }
+
+        if (!jsonError) {
+            if (settingsCache != nullptr) {
+                settingsCache->commit();
+            }
+            // Extract values from JSON and update the state.
+            state.chargeCurrent = doc["settings"]["charge_current"];
+            state.gridCurrent = doc["phase_currents"]["TOTAL"];
+            state.mode = modeFromId(doc["mode_id"].as<int>());
+            state.evseState = internEvseState(doc["evse"]["state"].as<const char *>());
+
+            // Clear any SmartEVSE-related error.
+            if (state.error == EVSE_ERROR_NO_HOST || state.error == EVSE_ERROR_JSON_FAILED ||
+                state.error == EVSE_ERROR_TIMEOUT) {
+                state.error = EVSE_ERROR_NONE;
+            }
+        } else {
+            state.connected = false;
+            state.error = EVSE_ERROR_JSON_FAILED;
+            LOG_PRINTF("==== fetchSettings() parsing JSON failed\n");
+        }
+    } else {
+        state.connected = false;
+        state.error = EVSE_ERROR_TIMEOUT;
+    }
+    http.end();
+    return httpResponseCode > 0;
+}
+
+bool EvseClient::probe(const EvseTarget &target) {
+    if (target.host[0] == '\0') {
+        return false;
+    }
+    updateUrls(target);
+    const bool reachable = http.probe(probeUrl, PROBE_TIMEOUT);
+    LOG_PRINTF("==== probe() %s: %s\n", probeUrl, reachable ? "up" : "down");
+    return reachable;
+}
+
+namespace {
+    /**
+     * Reads a fetched body, for the bitmap decoder.
+     */
+    struct BodySource {
+        const LcdBody &body;
+        size_t position;
+
+        size_t readBytes(uint8_t *buffer, size_t length) {
+            if (length > body.length - position) {
+                length = body.length - position;
+            }
+            memcpy(buffer, body.bytes + position, length);
+            position += length;
+            return length;
+        }
+    };
+}
+
+bool EvseClient::fetchLcd(LcdBody &body, const EvseTarget &target) {
+    body.valid = false;
+    body.length = 0;
+    if (target.host[0] == '\0') {
+        return false;
+    }
+
+    updateUrls(target);
+    const int httpResponseCode = http.get(lcdUrl, LCD_TIMEOUT);
+    LOG_PRINTF("==== fetchLcd() httpResponseCode: %d\n", httpResponseCode);
+    countResponse(httpResponseCode);
+
+    if (httpResponseCode >= 200 && httpResponseCode < 300) {
+        // Read up to the end of the body, one byte more tells it did not fit.
+        hal::ByteStream &stream = http.body();
+        size_t length = 0;
+        size_t read;
+        uint8_t overflow;
+        while (length < LCD_BODY_MAX_LEN &&
+               (read = stream.readBytes(body.bytes + length, LCD_BODY_MAX_LEN - length)) > 0) {
+            length += read;
+        }
+        body.length = static_cast<uint16_t>(length);
+        body.valid = length > 0 && (length < LCD_BODY_MAX_LEN || stream.readBytes(&overflow, 1) == 0);
+        if (!body.valid) {
+            LOG_PRINTF("==== fetchLcd() body empty or larger than %d bytes\n", LCD_BODY_MAX_LEN);
+        }
+    }
+    http.end();
+    return httpResponseCode > 0;
+}
+
+bool EvseClient::decodeLcd(const LcdBody &body, LcdFrame &frame) const {
+    frame.valid = false;
+    if (!body.valid) {
+        return false;
+    }
+
+    // Decode the bitmap one row at a time, straight into the frame.
+    StageTimer decodeTimer(metrics, STAGE_BMP_DECODE);
+    BodySource source = {body, 0};
+    BmpInfo info;
+    BmpStatus status = readBmpHeader(source, info);
+    if (status == BMP_OK && (info.width != LCD_WIDTH || info.height != LCD_HEIGHT)) {
+        status = BMP_UNSUPPORTED;
+    }
+    if (status == BMP_OK) {
+        status = readBmpRows(source, info, [&frame](const int y, const uint8_t *row) {
+            memcpy(frame.pixels[y], row, LCD_BYTES_PER_ROW);
+        });
+    }
+    if (status != BMP_OK) {
+        LOG_PRINTF("==== decodeLcd() decoding bitmap failed, status: %d\n", status);
+    }
+    frame.valid = status == BMP_OK;
+    return frame.valid;
+}
+
+bool EvseClient::sendModeChange(const int newMode, EvseSnapshot &state, const EvseTarget &target) {
+    // "/settings?mode=" + newMode + "&starttime=0&override_current=0&repeat=0";
+    char path[128];
+    snprintf(path, sizeof(path),
+             "/settings?mode=%d"
+             "&override_current=0&starttime=2025-05-15T00:27&stoptime=2025-05-15T00:27&repeat=0",
+             newMode);
+    char url[EVSE_HOST_LEN + 128];
+    formatUrl(url, sizeof(url), target, path);
+
+    const int httpResponseCode = http.post(url, SETTINGS_TIMEOUT);
+    countResponse(httpResponseCode);
+
+    if (httpResponseCode >= 200 && httpResponseCode < 300) {
+        // JSON parsing
+        static const JsonDocument filter = makeModeFilter();
+        JsonDocument doc(&arena);
+        const DeserializationError jsonError =
+                deserializeJson(doc, http.body(), DeserializationOption::Filter(filter));
+        if (!jsonError) {
+            // Clear all errors related to mode.
+            if (state.error == EVSE_ERROR_MODE_FAILED) {
+                state.error = EVSE_ERROR_NONE;
+            }
+
+            // The mode is returned as a string, accept a number as well.
+            const JsonVariantConst modeValue = doc["mode"];
+            const int modeId = modeValue.is<const char *>() ? atoi(modeValue.as<const char *>()) : modeValue.as<int>();
+            if (modeId == EVSE_MODE_SOLAR || modeId == EVSE_MODE_SMART) {
+                state.mode = modeFromId(modeId);
+            } else {
+                LOG_PRINTF("==== sendModeChange() failed, received unexpected modeId: %d\n", modeId);
+                state.error = EVSE_ERROR_MODE_FAILED;
+            }
+        } else {
+            LOG_PRINTF("=== sendModeChange() failed, JSON deserialization failed: %s\n", jsonError.c_str());
+            state.error = EVSE_ERROR_MODE_FAILED;
+        }
+    } else {
+        LOG_PRINTF("==== sendModeChange() failed, httpResponseCode: %d\n", httpResponseCode);
+        state.error = EVSE_ERROR_MODE_FAILED;
+    }
+    http.end();
+    return httpResponseCode > 0;
+}
@@ -0,0 +1,109 @@
+#ifndef EVSE_CLIENT_H
+#define EVSE_CLIENT_H
+
+#include "evse_state.h"
+#include "hal.h"
+#include "json_arena.h"
+#include "metrics.h"
+#include "settings_cache.h"
+
+// Room for the filtered /settings document and the mode change response.
+#define EVSE_CLIENT_JSON_ARENA_SIZE 2048
+#define EVSE_URL_LEN (EVSE_HOST_LEN + 32)
+
+/**
+ * Talks to the SmartEVSE HTTP API: /settings and /lcd.
+ */
+class EvseClient {
+public:
+    /**
+     * @param settingsCache Receives every valid /settings body, for the /api/evse/settings proxy. Optional.
+     * @param metrics Receives the response codes and the parse and decode times. Optional.
+     */
+    explicit EvseClient(hal::HttpClient &http, SettingsCache *settingsCache = nullptr, Metrics *metrics = nullptr)
+        : http(http), settingsCache(settingsCache), metrics(metrics), urlTarget(), settingsUrl(), lcdUrl(),
+          probeUrl() {
+    }
+
+    /**
+     * Fetches settings and status data from the SmartEVSE server.
+     *
+     * If the device is unreachable, it updates the state to indicate disconnection.
+     * The raw body goes to the settings cache, if there is one.
+     *
+     * @param state The state to update.
+     * @param target The SmartEVSE, by its cached address when known.
+     * @return False if the SmartEVSE could not be reached.
+     */
+    bool fetchSettings(EvseSnapshot &state, const EvseTarget &target);
+
+    /**
+     * Fetch the SmartEVSE LCD screen, without decoding it.
+     *
+     * @param body Receives the bitmap, marked invalid if the SmartEVSE could not be reached.
+     * @param target The SmartEVSE, by its cached address when known.
+     * @return False if the SmartEVSE could not be reached.
+     */
+    bool fetchLcd(LcdBody &body, const EvseTarget &target);
+
+    /**
+     * Decode a fetched LCD screen. Does not use the network, safe on another task than the fetches.
+     *
+     * @param frame Receives the bitmap, marked invalid if the body is invalid or not a bitmap of the LCD.
+     * @return False if the body could not be decoded.
+     */
+    bool decodeLcd(const LcdBody &body, LcdFrame &frame) const;
+
+    /**
+     * Send Mode Change.
+     *
+     * @param newMode 2 = Solar, 3 = Smart
+     * @param state The state to update.
+     * @param target The SmartEVSE, by its cached address when known.
+     * @return False if the SmartEVSE could not be reached.
+     */
+    bool sendModeChange(int newMode, EvseSnapshot &state, const EvseTarget &target);
+
+    /**
+     * Check that the SmartEVSE accepts connections, before sending it a request that would wait out a timeout.
+     *
+     * @param target The SmartEVSE, by its cached address when known.
+     * @return False if the SmartEVSE could not be reached.
+     */
+    bool probe(const EvseTarget &target);
+
+    /**
+     * @return The allocations of parsed responses that did not fit the arena. Safe from any task.
+     */
+    uint32_t getJsonArenaFallbacks() const {
+        return arena.getFallbacks();
+    }
+
+private:
+    hal::HttpClient &http;
+    SettingsCache *settingsCache;
+    Metrics *metrics;
+    // The documents of each request are parsed in here, not on the heap.
+    JsonArena<EVSE_CLIENT_JSON_ARENA_SIZE> arena;
+
+    // The URLs of urlTarget, formatted once.
+    EvseTarget urlTarget;
+    char settingsUrl[EVSE_URL_LEN];
+    char lcdUrl[EVSE_URL_LEN];
+    char probeUrl[EVSE_URL_LEN];
+
+    void countResponse(int httpResponseCode);
+
+    /**
+     * Format the URLs again if target is not the SmartEVSE they were formatted for.
+     */
+    void updateUrls(const EvseTarget &target);
+
+    /**
+     * Format the URL of path on the SmartEVSE, "http://<ip>:<port><path>" when the address is known,
+     * "http://<host>.local<path>" otherwise.
+     */
+    static void formatUrl(char *url, size_t size, const EvseTarget &target, const char *path);
+};
+
+#endif // EVSE_CLIENT_H
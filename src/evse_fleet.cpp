@@ -0,0 +1,118 @@
+#include "evse_fleet.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+EvseFleet::EvseFleet(EvsePoller *const *pollers) : pollers(), count(0), current(0) {
+    for (size_t i = 0; i < EVSE_MAX_UNITS; i++) {
+        this->pollers[i] = pollers[i];
+    }
+}
+
+void EvseFleet::setTargets(const EvseTarget *targets, size_t newCount) {
+    if (newCount > EVSE_MAX_UNITS) {
+        newCount = EVSE_MAX_UNITS;
+    }
+    for (size_t i = 0; i < newCount; i++) {
+        pollers[i]->setTarget(targets[i]);
+    }
+    count.store(newCount);
+    if (current >= newCount) {
+        current = 0;
+    }
+}
+
+uint32_t EvseFleet::consumeSnapshots() {
+    uint32_t changed = 0;
+    for (size_t i = 0; i < count.load(); i++) {
+        if (pollers[i]->consumeSnapshot()) {
+            changed |= 1u << i;
+        }
+    }
+    return changed;
+}
+
+FleetTotals EvseFleet::totals() const {
+    FleetTotals totals = {static_cast<int>(count.load()), 0, 0, 0};
+    for (size_t i = 0; i < count.load(); i++) {
+        const EvseSnapshot &snapshot = pollers[i]->snapshot();
+        if (snapshot.connected) {
+            totals.connected++;
+            totals.chargeCurrent += snapshot.chargeCurrent;
+            totals.gridCurrent += snapshot.gridCurrent;
+        }
+    }
+    return totals;
+}
+
+bool EvseFleet::swipe(const int step) {
+    const size_t units = count.load();
+    if (units < 2) {
+        return false;
+    }
+    current = (current + units + (step < 0 ? -1 : 1)) % units;
+    return true;
+}
+
+/**
+ * Format tenths of an ampere, with the sign also between 0 and -1 A.
+ */
+static int formatAmpere(const int tenths, char *out, const size_t size) {
+    return snprintf(out, size, "%s%d.%dA", tenths < 0 ? "-" : "", abs(tenths) / 10, abs(tenths) % 10);
+}
+
+size_t formatFleetTotals(const FleetTotals &totals, const size_t current, char *out, const size_t size) {
+    char grid[16];
+    char charge[16];
+    formatAmpere(totals.gridCurrent, grid, sizeof(grid));
+    formatAmpere(totals.chargeCurrent, charge, sizeof(charge));
+    const int written = snprintf(out, size, "%u/%d Grid %s Chg %s", static_cast<unsigned>(current + 1), totals.units,
+                                 grid, charge);
+    return written < 0 ? 0 : static_cast<size_t>(written) < size ? written : size - 1;
+}
+
+size_t formatTargetList(const EvseTarget *targets, const size_t count, char *out, const size_t size) {
+    size_t length = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < count && length < size; i++) {
+        const int written = snprintf(out + length, size - length, "%s%s@%s:%u", i > 0 ? "," : "",
+                                     targets[i].host, targets[i].ip,
+                                     static_cast<unsigned>(targets[i].port != 0 ? targets[i].port : 80));
+        if (written < 0 || static_cast<size_t>(written) >= size - length) {
+            // Drop the unit that did not fit.
+            out[length] = '\0';
+            break;
+        }
+        length += written;
+    }
+    return length;
+}
+
+size_t parseTargetList(const char *list, EvseTarget *targets, const size_t maxTargets) {
+    size_t count = 0;
+    while (*list != '\0' && count < maxTargets) {
+        const size_t entryLength = strcspn(list, ",");
+        const size_t hostLength = strcspn(list, "@,");
+        EvseTarget &target = targets[count];
+        target = EvseTarget();
+        target.port = 80;
+        snprintf(target.host, sizeof(target.host), "%.*s", static_cast<int>(hostLength), list);
+        if (hostLength < entryLength) {
+            const char *address = list + hostLength + 1;
+            const size_t ipLength = strcspn(address, ":,");
+            snprintf(target.ip, sizeof(target.ip), "%.*s", static_cast<int>(ipLength), address);
+            if (address[ipLength] == ':' && atoi(address + ipLength + 1) > 0) {
+                target.port = static_cast<uint16_t>(atoi(address + ipLength + 1));
+            }
+        }
+        if (target.host[0] != '\0') {
+            count++;
+        }
+        list += entryLength;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return count;
+}
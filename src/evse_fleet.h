@@ -0,0 +1,116 @@
+#ifndef EVSE_FLEET_H
+#define EVSE_FLEET_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "evse_poller.h"
+#include "evse_state.h"
+
+// SmartEVSE units polled at the same time.
+#define EVSE_MAX_UNITS 4
+// The unit list as stored in Preferences, see formatTargetList().
+#define EVSE_TARGET_LIST_LEN (EVSE_MAX_UNITS * (EVSE_HOST_LEN + EVSE_IP_LEN + 8))
+
+/**
+ * The sums over the units that answered.
+ */
+struct FleetTotals {
+    int units;
+    int connected;
+    int chargeCurrent;
+    int gridCurrent;
+};
+
+/**
+ * The SmartEVSE units of a site.
+ *
+ * Each unit has its own poller, polled by its own network task, so a unit that does not answer
+ * only delays itself. All methods run on the UI, except isActive() which the network tasks use.
+ */
+class EvseFleet {
+public:
+    /**
+     * @param pollers One per unit, EVSE_MAX_UNITS of them.
+     */
+    explicit EvseFleet(EvsePoller *const *pollers);
+
+    /**
+     * Poll these units, the first count pollers get a target and the others stop.
+     */
+    void setTargets(const EvseTarget *targets, size_t count);
+
+    size_t getCount() const {
+        return count.load();
+    }
+
+    /**
+     * @return True if the network task of the unit has a SmartEVSE to poll.
+     */
+    bool isActive(const size_t unit) const {
+        return unit < count.load();
+    }
+
+    EvsePoller &poller(const size_t unit) {
+        return *pollers[unit];
+    }
+
+    /**
+     * Take the snapshots the pollers published.
+     *
+     * @return A bit per unit with a new snapshot, read it with poller(unit).snapshot().
+     */
+    uint32_t consumeSnapshots();
+
+    /**
+     * @return The sums over the last consumed snapshots.
+     */
+    FleetTotals totals() const;
+
+    // ---- The unit on screen ----
+
+    size_t getCurrent() const {
+        return current;
+    }
+
+    EvsePoller &currentPoller() {
+        return *pollers[current];
+    }
+
+    /**
+     * Show the next unit, or the previous one with step -1, wrapping around.
+     *
+     * @return True if another unit is shown.
+     */
+    bool swipe(int step);
+
+private:
+    EvsePoller *pollers[EVSE_MAX_UNITS];
+    std::atomic<size_t> count;
+    size_t current;
+};
+
+/**
+ * Format the unit on screen and the totals for the fleet status line: "2/3 Grid -0.5A Chg 32.0A".
+ *
+ * @param current The unit on screen, counted from 0.
+ * @return The length of the line.
+ */
+size_t formatFleetTotals(const FleetTotals &totals, size_t current, char *out, size_t size);
+
+/**
+ * Format the units for Preferences: "host@ip:port" per unit, separated by commas. The address
+ * is empty when it is not known.
+ *
+ * @return The length of the list.
+ */
+size_t formatTargetList(const EvseTarget *targets, size_t count, char *out, size_t size);
+
+/**
+ * Parse a list made by formatTargetList(). Units without a host name are skipped.
+ *
+ * @return The number of units.
+ */
+size_t parseTargetList(const char *list, EvseTarget *targets, size_t maxTargets);
+
+#endif // EVSE_FLEET_H
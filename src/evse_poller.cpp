@@ -0,0 +1,211 @@
+#include "evse_poller.h"
+
+#include <cstring>
+
+#include "log.h"
+
+// Resolve at most this often while the SmartEVSE does not answer.
+constexpr uint32_t RESOLVE_INTERVAL = 30000;
+// Requests in a row that fail before a breaker opens, and how long it stays open.
+constexpr uint32_t BREAKER_THRESHOLD = 3;
+constexpr uint32_t BREAKER_BASE_BACKOFF = 2000;
+constexpr uint32_t BREAKER_MAX_BACKOFF = 60000;
+
+EvsePoller::EvsePoller(EvseClient &client, hal::Clock &clock, hal::Discovery &discovery, const PollRates &rates)
+    : client(client), clock(clock), discovery(discovery), fetched(clock), decoded(clock), rendered(clock),
+      framesSkipped(0), currentFrame(), pendingModeChange(0), settingsRequested(false), target(),
+      state{false, EVSE_MODE_SOLAR, "Not Connected", 0, 0, EVSE_ERROR_NONE, BREAKER_CLOSED}, scheduler(clock, rates),
+      // Seeded by address, so the pollers of different units back off differently.
+      lcdBreaker(clock, BREAKER_THRESHOLD, BREAKER_BASE_BACKOFF, BREAKER_MAX_BACKOFF,
+                 static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this))),
+      settingsBreaker(clock, BREAKER_THRESHOLD, BREAKER_BASE_BACKOFF, BREAKER_MAX_BACKOFF,
+                      static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)) ^ 0x9e3779b9u),
+      lastFrameHash(0), resolved(false), lastResolve(0) {
+}
+
+/**
+ * FNV-1a of the bitmap, 0 for an invalid body.
+ */
+static uint32_t hashBody(const LcdBody &body) {
+    if (!body.valid) {
+        return 0;
+    }
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < body.length; i++) {
+        hash = (hash ^ body.bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void EvsePoller::setTarget(const EvseTarget &newTarget) {
+    targets.back() = newTarget;
+    targets.publish();
+}
+
+void EvsePoller::requestModeChange(const EvseMode newMode) {
+    pendingModeChange.store(newMode);
+}
+
+void EvsePoller::requestSettings() {
+    settingsRequested.store(true);
+}
+
+BreakerState EvsePoller::breakerState() const {
+    if (lcdBreaker.getState() == BREAKER_OPEN || settingsBreaker.getState() == BREAKER_OPEN) {
+        return BREAKER_OPEN;
+    }
+    if (lcdBreaker.getState() == BREAKER_HALF_OPEN || settingsBreaker.getState() == BREAKER_HALF_OPEN) {
+        return BREAKER_HALF_OPEN;
+    }
+    return BREAKER_CLOSED;
+}
+
+void EvsePoller::publishState() {
+    state.breaker = breakerState();
+    snapshots.back() = state;
+    snapshots.publish();
+}
+
+bool EvsePoller::mayRequest(CircuitBreaker &breaker) {
+    if (!breaker.allow()) {
+        return false;
+    }
+    if (breaker.getState() == BREAKER_HALF_OPEN && !client.probe(target)) {
+        breaker.failure();
+        return false;
+    }
+    return true;
+}
+
+void EvsePoller::reportRequest(CircuitBreaker &breaker, const bool reachable) {
+    if (reachable) {
+        breaker.success();
+    } else {
+        breaker.failure();
+    }
+}
+
+void EvsePoller::resolveTarget() {
+    if (target.host[0] == '\0' || (resolved && clock.millis() - lastResolve < RESOLVE_INTERVAL)) {
+        return;
+    }
+    resolved = true;
+    lastResolve = clock.millis();
+
+    // Ask for this one host, a full service browse takes seconds.
+    char ip[EVSE_IP_LEN];
+    if (!discovery.resolve(target.host, ip, sizeof(ip))) {
+        LOG_PRINTF("==== resolveTarget() %s did not answer\n", target.host);
+        return;
+    }
+    if (strcmp(ip, target.ip) != 0) {
+        LOG_PRINTF("==== resolveTarget() %s moved from \"%s\" to \"%s\"\n", target.host, target.ip, ip);
+        copyString(target.ip, ip);
+        resolvedTargets.back() = target;
+        resolvedTargets.publish();
+    }
+}
+
+void EvsePoller::poll() {
+    // The user selected another SmartEVSE.
+    if (targets.consume()) {
+        target = targets.front();
+        scheduler.reset();
+        lcdBreaker.reset();
+        settingsBreaker.reset();
+        lastFrameHash = 0;
+        resolved = false;
+    }
+    if (target.ip[0] == '\0') {
+        resolveTarget();
+    }
+
+    const int newMode = pendingModeChange.exchange(0);
+    if (newMode != 0 && target.host[0] != '\0') {
+        if (!client.sendModeChange(newMode, state, target)) {
+            resolveTarget();
+        }
+        publishState();
+        // Show the effect of the change soon.
+        scheduler.boost();
+    }
+
+    // While a breaker is open, its endpoint is skipped and the UI keeps what it has. Only then is a slot of
+    // the ring reserved, as that may drop the oldest body. The LCD is fetched straight into it, unless the
+    // decode task is still reading that slot: the next poll() tries again, a half-open breaker stays so.
+    LcdBody *body = scheduler.lcdDue() && mayRequest(lcdBreaker) ? bodies.beginWrite() : nullptr;
+    if (body != nullptr) {
+        const bool reachable = client.fetchLcd(*body, target);
+        reportRequest(lcdBreaker, reachable);
+        if (!reachable) {
+            resolveTarget();
+        }
+        // The first frame after a new target is not a change.
+        const uint32_t hash = hashBody(*body);
+        scheduler.lcdFetched(reachable, lastFrameHash != 0 && hash != 0 && hash != lastFrameHash);
+        if (hash != 0) {
+            lastFrameHash = hash;
+        }
+        bodies.endWrite();
+        fetched.count();
+    }
+
+    if ((settingsRequested.exchange(false) || scheduler.settingsDue()) && mayRequest(settingsBreaker)) {
+        const bool reachable = client.fetchSettings(state, target);
+        reportRequest(settingsBreaker, reachable);
+        if (!reachable) {
+            resolveTarget();
+        }
+        scheduler.settingsFetched(reachable && state.connected, strcmp(state.evseState, "Charging") == 0);
+        publishState();
+    }
+
+    // A breaker opened or closed without a new /settings.
+    if (breakerState() != state.breaker) {
+        publishState();
+    }
+}
+
+size_t EvsePoller::decode() {
+    size_t count = 0;
+    while (const LcdBody *body = bodies.beginRead()) {
+        LcdFrame *frame = frames.beginWrite();
+        if (frame != nullptr) {
+            client.decodeLcd(*body, *frame);
+            frames.endWrite();
+            decoded.count();
+            count++;
+        } else {
+            // The UI is still copying that slot, a newer frame follows.
+            frames.countDropped();
+        }
+        bodies.endRead();
+    }
+    return count;
+}
+
+bool EvsePoller::consumeFrame() {
+    bool consumed = false;
+    while (const LcdFrame *frame = frames.beginRead()) {
+        if (consumed) {
+            framesSkipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        currentFrame = *frame;
+        frames.endRead();
+        consumed = true;
+    }
+    if (consumed) {
+        rendered.count();
+    }
+    return consumed;
+}
+
+PipelineStats EvsePoller::getPipelineStats() const {
+    PipelineStats stats;
+    stats.fetch = {static_cast<uint32_t>(bodies.size()), fetched.getTotal(), bodies.getDropped(),
+                   fetched.getPerSecond()};
+    stats.decode = {static_cast<uint32_t>(frames.size()), decoded.getTotal(), frames.getDropped(),
+                    decoded.getPerSecond()};
+    stats.render = {0, rendered.getTotal(), framesSkipped.load(std::memory_order_relaxed), rendered.getPerSecond()};
+    return stats;
+}
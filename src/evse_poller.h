@@ -0,0 +1,215 @@
+#ifndef EVSE_POLLER_H
+#define EVSE_POLLER_H
+
+#include <atomic>
+
+#include "circuit_breaker.h"
+#include "evse_client.h"
+#include "evse_state.h"
+#include "hal.h"
+#include "poll_scheduler.h"
+#include "spsc_ring.h"
+#include "throughput_counter.h"
+#include "triple_buffer.h"
+
+// Fetched LCD bitmaps waiting for the decode stage, and decoded frames waiting for the UI.
+#define EVSE_POLLER_BODY_RING 2
+#define EVSE_POLLER_FRAME_RING 2
+
+/**
+ * One stage of the LCD pipeline.
+ */
+struct PipelineStageStats {
+    // Waiting for the next stage.
+    uint32_t depth;
+    uint32_t total;
+    // Replaced by a newer one before the next stage took them.
+    uint32_t dropped;
+    float perSecond;
+};
+
+/**
+ * The LCD frames on their way from the SmartEVSE to the display.
+ */
+struct PipelineStats {
+    PipelineStageStats fetch;
+    PipelineStageStats decode;
+    PipelineStageStats render;
+};
+
+/**
+ * Polls one SmartEVSE and publishes the results, at the pace the PollScheduler sets.
+ *
+ * The LCD goes through three stages: poll() fetches it on the network task, decode() turns it into
+ * a frame on the decode task and consumeFrame() takes the newest frame on the UI. The stages meet in
+ * lock-free rings that drop the oldest value when full. /settings is parsed while it is read, on the
+ * network task, as the pace of the polling depends on it. All other methods run on the UI, which
+ * never blocks on the network.
+ */
+class EvsePoller {
+public:
+    EvsePoller(EvseClient &client, hal::Clock &clock, hal::Discovery &discovery,
+               const PollRates &rates = DEFAULT_POLL_RATES);
+
+    // ---- Network task ----
+
+    /**
+     * Fetch whatever is due and publish the results. Call this repeatedly.
+     */
+    void poll();
+
+    /**
+     * @return True if a fetched LCD waits for decode().
+     */
+    bool lcdWaiting() const {
+        return bodies.size() > 0;
+    }
+
+    // ---- Decode task ----
+
+    /**
+     * Decode the LCD bitmaps poll() fetched, for the UI.
+     *
+     * @return The frames decoded.
+     */
+    size_t decode();
+
+    // ---- UI ----
+
+    /**
+     * Tell the poller which SmartEVSE to poll.
+     *
+     * @param target The SmartEVSE, with its cached address if there is one.
+     */
+    void setTarget(const EvseTarget &target);
+
+    /**
+     * Ask the poller to change the mode, to EVSE_MODE_SOLAR or EVSE_MODE_SMART.
+     */
+    void requestModeChange(EvseMode newMode);
+
+    /**
+     * Ask the poller to fetch /settings now instead of when it is due. Requests that arrive
+     * before the fetch share it. Safe to call from any task.
+     */
+    void requestSettings();
+
+    /**
+     * Poll at these intervals from the next poll on.
+     */
+    void setPollRates(const PollRates &rates) {
+        scheduler.setRates(rates);
+    }
+
+    /**
+     * @return The pace and the achieved frame and request rates.
+     */
+    PollStats getPollStats() const {
+        return scheduler.getStats();
+    }
+
+    BreakerStatus getLcdBreakerStatus() const {
+        return lcdBreaker.getStatus();
+    }
+
+    BreakerStatus getSettingsBreakerStatus() const {
+        return settingsBreaker.getStatus();
+    }
+
+    /**
+     * @return True if a new snapshot was published since the previous call, read it with snapshot().
+     */
+    bool consumeSnapshot() {
+        return snapshots.consume();
+    }
+
+    const EvseSnapshot &snapshot() const {
+        return snapshots.front();
+    }
+
+    /**
+     * Take the newest decoded frame, older ones that are still waiting are skipped.
+     *
+     * @return True if a new frame was decoded since the previous call, read it with frame().
+     */
+    bool consumeFrame();
+
+    const LcdFrame &frame() const {
+        return currentFrame;
+    }
+
+    /**
+     * @return The depth, throughput and drops of each stage. Safe from any task.
+     */
+    PipelineStats getPipelineStats() const;
+
+    /**
+     * @return True if the poller resolved a new address for the target since the previous call,
+     * read it with resolvedTarget() to cache it.
+     */
+    bool consumeResolvedTarget() {
+        return resolvedTargets.consume();
+    }
+
+    const EvseTarget &resolvedTarget() const {
+        return resolvedTargets.front();
+    }
+
+private:
+    EvseClient &client;
+    hal::Clock &clock;
+    hal::Discovery &discovery;
+
+    TripleBuffer<EvseTarget> targets;
+    TripleBuffer<EvseTarget> resolvedTargets;
+    TripleBuffer<EvseSnapshot> snapshots;
+    SpscRing<LcdBody, EVSE_POLLER_BODY_RING> bodies;
+    SpscRing<LcdFrame, EVSE_POLLER_FRAME_RING> frames;
+    // Counted by each stage.
+    ThroughputCounter fetched;
+    ThroughputCounter decoded;
+    ThroughputCounter rendered;
+    std::atomic<uint32_t> framesSkipped;
+
+    // Owned by the UI, the newest frame taken from frames.
+    LcdFrame currentFrame;
+    // Mode change requested by the UI, 0 (Off, never requested) when none is pending.
+    std::atomic<int> pendingModeChange;
+    std::atomic<bool> settingsRequested;
+
+    // Owned by the network task.
+    EvseTarget target;
+    EvseSnapshot state;
+    PollScheduler scheduler;
+    CircuitBreaker lcdBreaker;
+    CircuitBreaker settingsBreaker;
+    // To tell whether the LCD changed.
+    uint32_t lastFrameHash;
+    bool resolved;
+    uint32_t lastResolve;
+
+    void publishState();
+
+    /**
+     * @return The state of the breakers together, see EvseSnapshot::breaker.
+     */
+    BreakerState breakerState() const;
+
+    /**
+     * Ask the breaker of an endpoint whether to send a request. When it is half-open, the SmartEVSE
+     * is probed first and the request only goes out if it accepts the connection.
+     */
+    bool mayRequest(CircuitBreaker &breaker);
+
+    /**
+     * Report the result of a request to the breaker of its endpoint.
+     */
+    void reportRequest(CircuitBreaker &breaker, bool reachable);
+
+    /**
+     * Look up the address of the target by name, after a request failed or when none is cached.
+     */
+    void resolveTarget();
+};
+
+#endif // EVSE_POLLER_H
@@ -0,0 +1,69 @@
+#include "evse_state.h"
+
+#include <cstring>
+#include <mutex>
+
+// States that are not in KNOWN_STATES, interned once each.
+#define EVSE_STATE_POOL_SIZE 8
+#define EVSE_STATE_LEN 40
+
+// The states of the SmartEVSE firmware's web API.
+static const char *const KNOWN_STATES[] = {
+    "Ready to Charge", "Connected to EV", "Charging", "D", "Request State B", "State B OK", "Request State C",
+    "State C OK", "Activate", "Charging Stopped", "Stop Charging", "Modem Setup", "Modem Request", "Modem Done",
+    "Modem Denied"
+};
+
+static std::mutex statePoolMutex;
+static char statePool[EVSE_STATE_POOL_SIZE][EVSE_STATE_LEN];
+static size_t statePoolCount = 0;
+
+EvseMode modeFromId(const int modeId) {
+    return modeId >= EVSE_MODE_OFF && modeId < EVSE_MODE_UNKNOWN ? static_cast<EvseMode>(modeId) : EVSE_MODE_UNKNOWN;
+}
+
+const char *modeName(const EvseMode mode) {
+    static const char *const NAMES[] = {"Off", "Normal", "Solar", "Smart", "Pause", "Unknown"};
+    return mode >= EVSE_MODE_OFF && mode <= EVSE_MODE_UNKNOWN ? NAMES[mode] : NAMES[EVSE_MODE_UNKNOWN];
+}
+
+const char *errorMessage(const EvseError error) {
+    switch (error) {
+        case EVSE_ERROR_NONE:
+            return "";
+        case EVSE_ERROR_NO_HOST:
+            return "No SmartEVSE host";
+        case EVSE_ERROR_JSON_FAILED:
+            return "SmartEVSE Failed";
+        case EVSE_ERROR_TIMEOUT:
+            return "SmartEVSE Timeout";
+        case EVSE_ERROR_MODE_FAILED:
+            return "Mode failed";
+        case EVSE_ERROR_MDNS:
+            return "Error starting mDNS";
+    }
+    return "";
+}
+
+const char *internEvseState(const char *state) {
+    if (state == nullptr) {
+        return "";
+    }
+    for (const char *known: KNOWN_STATES) {
+        if (strcmp(known, state) == 0) {
+            return known;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(statePoolMutex);
+    for (size_t i = 0; i < statePoolCount; i++) {
+        if (strncmp(statePool[i], state, EVSE_STATE_LEN - 1) == 0) {
+            return statePool[i];
+        }
+    }
+    if (statePoolCount == EVSE_STATE_POOL_SIZE) {
+        return "Unknown";
+    }
+    copyString(statePool[statePoolCount], state);
+    return statePool[statePoolCount++];
+}
@@ -0,0 +1,119 @@
+#ifndef EVSE_STATE_H
+#define EVSE_STATE_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include "circuit_breaker.h"
+
+// Size of the SmartEVSE LCD.
+#define LCD_WIDTH 128
+#define LCD_HEIGHT 64
+#define LCD_BYTES_PER_ROW (LCD_WIDTH / 8)
+// The largest /lcd response kept for decoding: the 1 bit per pixel bitmap, with room for a larger header.
+#define LCD_BODY_MAX_LEN 1536
+
+#define EVSE_HOST_LEN 64
+// An IPv4 address, dotted.
+#define EVSE_IP_LEN 16
+
+/**
+ * Copy a C string into a fixed size character array, always zero terminated.
+ */
+template<size_t N>
+void copyString(char (&destination)[N], const char *source) {
+    snprintf(destination, N, "%s", source != nullptr ? source : "");
+}
+
+/**
+ * The SmartEVSE the network task talks to, published by the UI.
+ */
+struct EvseTarget {
+    char host[EVSE_HOST_LEN];
+    // The resolved address of host, empty when unknown. Used instead of "<host>.local".
+    char ip[EVSE_IP_LEN];
+    uint16_t port;
+};
+
+/**
+ * The charging mode, by its SmartEVSE mode_id.
+ */
+enum EvseMode {
+    EVSE_MODE_OFF,
+    EVSE_MODE_NORMAL,
+    EVSE_MODE_SOLAR,
+    EVSE_MODE_SMART,
+    EVSE_MODE_PAUSE,
+    EVSE_MODE_UNKNOWN
+};
+
+enum EvseError {
+    EVSE_ERROR_NONE,
+    EVSE_ERROR_NO_HOST,
+    // The response could not be parsed.
+    EVSE_ERROR_JSON_FAILED,
+    EVSE_ERROR_TIMEOUT,
+    EVSE_ERROR_MODE_FAILED,
+    // Of the display itself.
+    EVSE_ERROR_MDNS
+};
+
+/**
+ * @return The mode for a SmartEVSE mode_id, EVSE_MODE_UNKNOWN for ids it does not know.
+ */
+EvseMode modeFromId(int modeId);
+
+/**
+ * @return "Off", "Normal", "Solar", "Smart", "Pause" or "Unknown".
+ */
+const char *modeName(EvseMode mode);
+
+/**
+ * @return The message to show, "" for EVSE_ERROR_NONE.
+ */
+const char *errorMessage(EvseError error);
+
+/**
+ * The state the SmartEVSE reports, like "Charging", as a string that lives forever, so snapshots
+ * hold a pointer instead of a copy. States the SmartEVSE firmware knows are in a table, others are
+ * added to a small pool once. Safe from any task.
+ *
+ * @return "Unknown" when the pool is full, "" for nullptr.
+ */
+const char *internEvseState(const char *state);
+
+/**
+ * Immutable copy of the SmartEVSE state, published by the network task after every poll.
+ */
+struct EvseSnapshot {
+    bool connected;
+    EvseMode mode;
+    // Interned, see internEvseState().
+    const char *evseState;
+    int chargeCurrent;
+    int gridCurrent;
+    EvseError error;
+    // Open when either endpoint is, half-open when either is.
+    BreakerState breaker;
+};
+
+/**
+ * One frame of the SmartEVSE LCD, as received from the /lcd endpoint.
+ * When valid is false, the SmartEVSE could not be reached.
+ */
+struct LcdFrame {
+    bool valid;
+    uint8_t pixels[LCD_HEIGHT][LCD_BYTES_PER_ROW];
+};
+
+/**
+ * A /lcd response as it came in, before it is decoded into an LcdFrame.
+ * When valid is false, the SmartEVSE could not be reached or the body did not fit.
+ */
+struct LcdBody {
+    bool valid;
+    uint16_t length;
+    uint8_t bytes[LCD_BODY_MAX_LEN];
+};
+
+#endif // EVSE_STATE_H
@@ -0,0 +1,173 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Thin interfaces over the hardware and the network, so the polling, parsing and rendering
+ * logic does not depend on M5Unified or the Arduino core and also builds for [env:native].
+ *
+ * The ESP32 implementations are in hal_esp32.h, the fakes for the native tests in test/test_native.
+ */
+namespace hal {
+    class Clock {
+    public:
+        virtual ~Clock() = default;
+
+        virtual uint32_t millis() = 0;
+
+        /**
+         * For measuring short durations, wraps after 71 minutes.
+         */
+        virtual uint32_t micros() = 0;
+
+        virtual void delay(uint32_t ms) = 0;
+    };
+
+    /**
+     * The part of the display the LCD mirror needs.
+     */
+    class Display {
+    public:
+        virtual ~Display() = default;
+
+        virtual int width() = 0;
+
+        virtual int height() = 0;
+
+        virtual void startWrite() = 0;
+
+        virtual void endWrite() = 0;
+
+        virtual void setAddrWindow(int x, int y, int width, int height) = 0;
+
+        virtual void pushPixels(const uint16_t *pixels, uint32_t count) = 0;
+
+        /**
+         * Start pushing pixels with DMA and return while they are sent. The pixels must not change,
+         * and the address window must not move, until waitDma().
+         */
+        virtual void pushPixelsDma(const uint16_t *pixels, uint32_t count) = 0;
+
+        /**
+         * Wait until the pixels of pushPixelsDma() are sent.
+         */
+        virtual void waitDma() = 0;
+    };
+
+    /**
+     * A response body. Reads wait up to the request timeout, like Stream::readBytes().
+     */
+    class ByteStream {
+    public:
+        virtual ~ByteStream() = default;
+
+        virtual size_t readBytes(uint8_t *buffer, size_t length) = 0;
+
+        // For ArduinoJson, which reads from any class with read() and readBytes(char *, size_t).
+        size_t readBytes(char *buffer, const size_t length) {
+            return readBytes(reinterpret_cast<uint8_t *>(buffer), length);
+        }
+
+        int read() {
+            uint8_t c;
+            return readBytes(&c, 1) == 1 ? c : -1;
+        }
+    };
+
+    struct HttpStats {
+        uint32_t connectionsOpened;
+        uint32_t requestsServed;
+    };
+
+    class HttpClient {
+    public:
+        virtual ~HttpClient() = default;
+
+        /**
+         * Send a GET request.
+         *
+         * @return The HTTP status code, or a negative value if the request failed.
+         */
+        virtual int get(const char *url, uint32_t timeoutMs) = 0;
+
+        /**
+         * Send a POST request without a body.
+         *
+         * @return The HTTP status code, or a negative value if the request failed.
+         */
+        virtual int post(const char *url, uint32_t timeoutMs) = 0;
+
+        /**
+         * Connect to the host of url without sending a request, a cheap check that it is up.
+         * The next request to that host uses the connection.
+         *
+         * @return False if the host could not be reached.
+         */
+        virtual bool probe(const char *url, uint32_t timeoutMs) = 0;
+
+        /**
+         * The body of the last response, without any transfer encoding. Valid until end().
+         */
+        virtual ByteStream &body() = 0;
+
+        virtual void end() = 0;
+
+        /**
+         * Connections opened versus requests served, to see how well connections are reused.
+         */
+        virtual HttpStats getStats() const = 0;
+    };
+
+    struct DiscoveredHost {
+        char host[64];
+        char ip[16];
+        uint16_t port;
+    };
+
+    /**
+     * Service discovery (mDNS).
+     */
+    class Discovery {
+    public:
+        virtual ~Discovery() = default;
+
+        /**
+         * Browse for instances of a service, like "http" over "tcp".
+         *
+         * @param timeoutMs How long to collect answers.
+         * @return The number of hosts written to hosts.
+         */
+        virtual size_t browse(const char *service, const char *protocol, DiscoveredHost *hosts, size_t maxHosts,
+                              uint32_t timeoutMs) = 0;
+
+        /**
+         * Resolve the address of a single host, without browsing all services.
+         *
+         * @param host The host name, without ".local".
+         * @param ip Receives the dotted IPv4 address.
+         * @return False if the host did not answer.
+         */
+        virtual bool resolve(const char *host, char *ip, size_t ipLength) = 0;
+    };
+
+    /**
+     * Persistent key/value storage (Preferences).
+     */
+    class Storage {
+    public:
+        virtual ~Storage() = default;
+
+        /**
+         * Read a string, an empty string if the key does not exist.
+         *
+         * @return The length of the value.
+         */
+        virtual size_t getString(const char *key, char *value, size_t maxLength) = 0;
+
+        virtual bool putString(const char *key, const char *value) = 0;
+    };
+}
+
+#endif // HAL_H
@@ -0,0 +1,318 @@
+#include "hal_esp32.h"
+
+#include <ESPmDNS.h>
+#include <atomic>
+#include <mdns.h>
+
+#ifdef ALLOC_COUNTER
+static std::atomic<TaskHandle_t> watchedTask(nullptr);
+static std::atomic<uint32_t> allocationCount(0);
+
+static void countAllocation() {
+    if (watchedTask.load(std::memory_order_relaxed) == xTaskGetCurrentTaskHandle()) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// The linker sends every call to malloc, calloc and realloc here (-Wl,--wrap=malloc, ...), new included.
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(const size_t size) {
+    countAllocation();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(const size_t count, const size_t size) {
+    countAllocation();
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, const size_t size) {
+    countAllocation();
+    return __real_realloc(pointer, size);
+}
+}
+
+void watchAllocations() {
+    watchedTask.store(xTaskGetCurrentTaskHandle());
+}
+
+uint32_t getAllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+#else
+void watchAllocations() {
+}
+
+uint32_t getAllocationCount() {
+    return 0;
+}
+#endif
+
+uint32_t EspClock::millis() {
+    return ::millis();
+}
+
+uint32_t EspClock::micros() {
+    return ::micros();
+}
+
+void EspClock::delay(const uint32_t ms) {
+    ::delay(ms);
+}
+
+int EspDisplay::width() {
+    return M5.Display.width();
+}
+
+int EspDisplay::height() {
+    return M5.Display.height();
+}
+
+void EspDisplay::startWrite() {
+    M5.Display.startWrite();
+}
+
+void EspDisplay::endWrite() {
+    M5.Display.endWrite();
+}
+
+void EspDisplay::setAddrWindow(const int x, const int y, const int width, const int height) {
+    M5.Display.setAddrWindow(x, y, width, height);
+}
+
+void EspDisplay::pushPixels(const uint16_t *pixels, const uint32_t count) {
+    M5.Display.pushPixels(pixels, static_cast<int32_t>(count));
+}
+
+void EspDisplay::pushPixelsDma(const uint16_t *pixels, const uint32_t count) {
+    M5.Display.pushPixelsDMA(pixels, static_cast<int32_t>(count));
+}
+
+void EspDisplay::waitDma() {
+    M5.Display.waitDMA();
+}
+
+SpriteWidget::SpriteWidget(const int x, const int y, const int width, const int height, const DrawFunction draw)
+    : Widget(x, y, width, height), canvas(&M5.Display), draw(draw) {
+}
+
+bool SpriteWidget::begin() {
+    canvas.setColorDepth(16);
+    canvas.setPsram(true);
+    return canvas.createSprite(getWidth(), getHeight()) != nullptr;
+}
+
+void SpriteWidget::render(const uint32_t value) {
+    draw(canvas, value);
+}
+
+void SpriteWidget::push() {
+    canvas.pushSprite(getX(), getY());
+}
+
+EspHttpClient::EspHttpClient(Metrics *metrics)
+    : metrics(metrics), host(), port(0), connectionsOpened(0), requestsServed(0) {
+    // The SmartEVSE sends the bitmap as a chunked response.
+    const char *headerKeys[] = {"Transfer-Encoding"};
+    http.collectHeaders(headerKeys, 1);
+    http.setReuse(true);
+}
+
+int EspHttpClient::get(const char *url, const uint32_t timeoutMs) {
+    return send("GET", url, timeoutMs);
+}
+
+int EspHttpClient::post(const char *url, const uint32_t timeoutMs) {
+    return send("POST", url, timeoutMs);
+}
+
+bool EspHttpClient::probe(const char *url, const uint32_t timeoutMs) {
+    selectHost(url);
+    if (client.connected()) {
+        return true;
+    }
+    if (!client.connect(host, port, static_cast<int32_t>(timeoutMs))) {
+        return false;
+    }
+    connectionsOpened++;
+    return true;
+}
+
+void EspHttpClient::selectHost(const char *url) {
+    // "http://host[:port]/path"
+    const char *scheme = strstr(url, "://");
+    const char *hostStart = scheme != nullptr ? scheme + 3 : url;
+    const size_t hostLength = strcspn(hostStart, ":/");
+    const uint16_t urlPort = hostStart[hostLength] == ':' ? atoi(hostStart + hostLength + 1) : 80;
+    char urlHost[EVSE_HOST_LEN];
+    snprintf(urlHost, sizeof(urlHost), "%.*s", static_cast<int>(hostLength), hostStart);
+
+    if (port != urlPort || strcmp(host, urlHost) != 0) {
+        // Another host, or the SmartEVSE moved to another address.
+        client.stop();
+        copyString(host, urlHost);
+        port = urlPort;
+    }
+}
+
+int EspHttpClient::send(const char *method, const char *url, const uint32_t timeoutMs) {
+    selectHost(url);
+    for (bool retried = false;; retried = true) {
+        // WiFiClient::connected() also notices when the server closed the connection.
+        const bool reused = client.connected();
+        if (!reused) {
+            // Connect here rather than in HTTPClient, to time it.
+            StageTimer connectTimer(metrics, STAGE_HTTP_CONNECT);
+            if (!client.connect(host, port, static_cast<int32_t>(timeoutMs))) {
+                return HTTPC_ERROR_CONNECTION_REFUSED;
+            }
+            connectionsOpened++;
+            Serial.printf("==== EspHttpClient opened connection to %s, connections opened: %u, requests served: %u\n",
+                          host, static_cast<unsigned>(connectionsOpened.load()),
+                          static_cast<unsigned>(requestsServed.load()));
+        }
+        http.begin(client, url);
+        http.setTimeout(timeoutMs);
+        http.addHeader("User-Agent", "SmartEVSE-display");
+        if (strcmp(method, "POST") == 0) {
+            http.addHeader("Content-Length", "0");
+        }
+
+        int httpResponseCode;
+        {
+            StageTimer firstByteTimer(metrics, STAGE_HTTP_FIRST_BYTE);
+            httpResponseCode = http.sendRequest(method);
+        }
+        if (httpResponseCode > 0) {
+            requestsServed++;
+            responseBody.begin(http.getStreamPtr(), http.header("Transfer-Encoding").equalsIgnoreCase("chunked"),
+                               http.getSize());
+            return httpResponseCode;
+        }
+
+        client.stop();
+        // The server closed the kept-alive connection before the request got through, retry on a new one.
+        const bool connectionClosed = httpResponseCode == HTTPC_ERROR_SEND_HEADER_FAILED ||
+                                      httpResponseCode == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+                                      httpResponseCode == HTTPC_ERROR_CONNECTION_LOST;
+        if (!reused || retried || !connectionClosed) {
+            return httpResponseCode;
+        }
+    }
+}
+
+hal::ByteStream &EspHttpClient::body() {
+    return responseBody;
+}
+
+void EspHttpClient::end() {
+    // The next response on this connection starts where this body ends.
+    const bool complete = responseBody.drain();
+    if (metrics != nullptr && responseBody.isOpen()) {
+        metrics->record(STAGE_HTTP_BODY, responseBody.getReadTime());
+    }
+    http.end();
+    if (!complete) {
+        client.stop();
+    }
+    responseBody.begin(nullptr, false, 0);
+}
+
+void EspHttpClient::Body::begin(WiFiClient *client, const bool isChunked, const int contentLength) {
+    source.client = client;
+    chunkedReader.reset();
+    chunked = isChunked;
+    remaining = contentLength;
+    readTime = 0;
+}
+
+size_t EspHttpClient::Body::readBytes(uint8_t *buffer, size_t length) {
+    if (source.client == nullptr) {
+        return 0;
+    }
+    const uint32_t start = ::micros();
+    size_t received;
+    if (chunked) {
+        received = chunkedReader.readBytes(buffer, length);
+    } else {
+        if (remaining >= 0 && length > static_cast<size_t>(remaining)) {
+            length = remaining;
+        }
+        received = source.readBytes(buffer, length);
+        if (remaining >= 0) {
+            remaining -= static_cast<int>(received);
+        }
+    }
+    readTime += ::micros() - start;
+    return received;
+}
+
+bool EspHttpClient::Body::drain() {
+    if (source.client == nullptr) {
+        return true;
+    }
+    uint8_t buffer[64];
+    while (readBytes(buffer, sizeof(buffer)) > 0) {
+    }
+    return chunked ? chunkedReader.atEnd() : remaining == 0;
+}
+
+size_t EspDiscovery::browse(const char *service, const char *protocol, hal::DiscoveredHost *hosts,
+                            const size_t maxHosts, const uint32_t timeoutMs) {
+    // MDNS.queryService() always waits 3 s, query the IDF directly for a shorter timeout.
+    char serviceType[32];
+    char proto[8];
+    snprintf(serviceType, sizeof(serviceType), "_%s", service);
+    snprintf(proto, sizeof(proto), "_%s", protocol);
+    mdns_result_t *results = nullptr;
+    if (mdns_query_ptr(serviceType, proto, timeoutMs, maxHosts, &results) != ESP_OK) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (const mdns_result_t *result = results; result != nullptr && count < maxHosts; result = result->next) {
+        if (result->hostname == nullptr) {
+            continue;
+        }
+        copyString(hosts[count].host, result->hostname);
+        hosts[count].ip[0] = '\0';
+        for (const mdns_ip_addr_t *address = result->addr; address != nullptr; address = address->next) {
+            if (address->addr.type == ESP_IPADDR_TYPE_V4) {
+                snprintf(hosts[count].ip, sizeof(hosts[count].ip), IPSTR, IP2STR(&address->addr.u_addr.ip4));
+                break;
+            }
+        }
+        hosts[count].port = result->port;
+        count++;
+    }
+    mdns_query_results_free(results);
+    return count;
+}
+
+bool EspDiscovery::resolve(const char *host, char *ip, const size_t ipLength) {
+    const IPAddress address = MDNS.queryHost(host, 2000);
+    if (static_cast<uint32_t>(address) == 0) {
+        return false;
+    }
+    snprintf(ip, ipLength, "%s", address.toString().c_str());
+    return true;
+}
+
+void EspStorage::begin(const char *name) {
+    preferences.begin(name, false);
+}
+
+size_t EspStorage::getString(const char *key, char *value, const size_t maxLength) {
+    // Returns an empty String by default if the key doesn't exist.
+    const String stored = preferences.getString(key);
+    snprintf(value, maxLength, "%s", stored.c_str());
+    return stored.length();
+}
+
+bool EspStorage::putString(const char *key, const char *value) {
+    return preferences.putString(key, value) > 0 || value[0] == '\0';
+}
@@ -0,0 +1,206 @@
+#ifndef HAL_ESP32_H
+#define HAL_ESP32_H
+
+#include <M5Unified.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <atomic>
+
+#include "evse_state.h"
+#include "hal.h"
+#include "http_chunked.h"
+#include "metrics.h"
+#include "widget.h"
+
+/**
+ * The hal interfaces on the M5Stack, on top of M5Unified and the Arduino core.
+ */
+
+class EspClock : public hal::Clock {
+public:
+    uint32_t millis() override;
+
+    uint32_t micros() override;
+
+    void delay(uint32_t ms) override;
+};
+
+class EspDisplay : public hal::Display {
+public:
+    int width() override;
+
+    int height() override;
+
+    void startWrite() override;
+
+    void endWrite() override;
+
+    void setAddrWindow(int x, int y, int width, int height) override;
+
+    void pushPixels(const uint16_t *pixels, uint32_t count) override;
+
+    void pushPixelsDma(const uint16_t *pixels, uint32_t count) override;
+
+    void waitDma() override;
+};
+
+/**
+ * A widget drawn on its own sprite, pushed to M5.Display in one go.
+ */
+class SpriteWidget : public Widget {
+public:
+    /**
+     * Draws the value on the whole sprite, which is width by height pixels.
+     */
+    typedef void (*DrawFunction)(M5Canvas &canvas, uint32_t value);
+
+    SpriteWidget(int x, int y, int width, int height, DrawFunction draw);
+
+    /**
+     * Allocate the sprite, in PSRAM when there is any. Call once, before the widget is composed.
+     *
+     * @return False if there was no memory for it.
+     */
+    bool begin();
+
+protected:
+    void render(uint32_t value) override;
+
+    void push() override;
+
+private:
+    M5Canvas canvas;
+    DrawFunction draw;
+};
+
+/**
+ * HTTP client that keeps its connection open, and reuses it for the next request to the same host.
+ * Each poller talks to one SmartEVSE, so a request to another host simply reconnects. When the server
+ * closed the connection, the request is sent once more on a new one.
+ */
+class EspHttpClient : public hal::HttpClient {
+public:
+    /**
+     * @param metrics Receives the connect, first byte and body times. Optional.
+     */
+    EspHttpClient(Metrics *metrics = nullptr); // NOLINT(*-explicit-constructor), brace-initialized in arrays
+
+    int get(const char *url, uint32_t timeoutMs) override;
+
+    int post(const char *url, uint32_t timeoutMs) override;
+
+    bool probe(const char *url, uint32_t timeoutMs) override;
+
+    hal::ByteStream &body() override;
+
+    void end() override;
+
+    /**
+     * Safe from any task.
+     */
+    hal::HttpStats getStats() const override {
+        return {connectionsOpened.load(), requestsServed.load()};
+    }
+
+private:
+
+    struct ClientSource {
+        WiFiClient *client;
+
+        size_t readBytes(uint8_t *buffer, const size_t length) {
+            return client->readBytes(buffer, length);
+        }
+    };
+
+    /**
+     * The response body, without the chunked transfer encoding.
+     */
+    class Body : public hal::ByteStream {
+    public:
+        Body() : source{nullptr}, chunkedReader(source), chunked(false), remaining(0), readTime(0) {
+        }
+
+        /**
+         * @param contentLength The Content-Length, -1 if unknown.
+         */
+        void begin(WiFiClient *client, bool isChunked, int contentLength);
+
+        size_t readBytes(uint8_t *buffer, size_t length) override;
+
+        /**
+         * Read and discard the rest of the body.
+         *
+         * @return True if the end of the body was reached, so the connection can be reused.
+         */
+        bool drain();
+
+        bool isOpen() const {
+            return source.client != nullptr;
+        }
+
+        /**
+         * The µs spent waiting for the body since begin().
+         */
+        uint32_t getReadTime() const {
+            return readTime;
+        }
+
+    private:
+        ClientSource source;
+        ChunkedReader<ClientSource> chunkedReader;
+        bool chunked;
+        // Bytes left of a body with a Content-Length, -1 if unknown.
+        int remaining;
+        uint32_t readTime;
+    };
+
+    HTTPClient http;
+    Metrics *metrics;
+    Body responseBody;
+    // The host the connection is open to, or was last.
+    char host[EVSE_HOST_LEN];
+    uint16_t port;
+    WiFiClient client;
+    std::atomic<uint32_t> connectionsOpened;
+    std::atomic<uint32_t> requestsServed;
+
+    int send(const char *method, const char *url, uint32_t timeoutMs);
+
+    /**
+     * Take the host of the url, closing the connection when it was open to another host.
+     */
+    void selectHost(const char *url);
+};
+
+class EspDiscovery : public hal::Discovery {
+public:
+    size_t browse(const char *service, const char *protocol, hal::DiscoveredHost *hosts, size_t maxHosts,
+                  uint32_t timeoutMs) override;
+
+    bool resolve(const char *host, char *ip, size_t ipLength) override;
+};
+
+class EspStorage : public hal::Storage {
+public:
+    void begin(const char *name);
+
+    size_t getString(const char *key, char *value, size_t maxLength) override;
+
+    bool putString(const char *key, const char *value) override;
+
+private:
+    Preferences preferences;
+};
+
+/**
+ * Count the heap allocations of the calling task from now on, to check that loop() does not allocate.
+ * Only counted in builds with ALLOC_COUNTER, see [env:m5stack-core2-alloc-check] in platformio.ini.
+ */
+void watchAllocations();
+
+/**
+ * @return The allocations of the watched task so far, always 0 without ALLOC_COUNTER.
+ */
+uint32_t getAllocationCount();
+
+#endif // HAL_ESP32_H
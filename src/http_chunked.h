@@ -0,0 +1,136 @@
+#ifndef HTTP_CHUNKED_H
+#define HTTP_CHUNKED_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Removes the HTTP/1.1 chunked transfer encoding from a response body.
+ *
+ * HTTPClient::getStreamPtr() returns the raw socket, so a chunked body still contains the
+ * chunk size lines. Wrap the stream in a ChunkedReader to read just the data.
+ */
+template<typename Source>
+class ChunkedReader {
+public:
+    explicit ChunkedReader(Source &source) : source(source), remaining(0), started(false), finished(false) {
+    }
+
+    /**
+     * Same contract as Stream::readBytes(): returns less than length only on timeout or at the end of the body.
+     */
+    size_t readBytes(uint8_t *buffer, const size_t length) {
+        size_t total = 0;
+        while (total < length) {
+            if (remaining == 0 && !nextChunk()) {
+                break;
+            }
+            const size_t wanted = length - total < remaining ? length - total : remaining;
+            const size_t received = source.readBytes(buffer + total, wanted);
+            total += received;
+            remaining -= received;
+            if (received < wanted) {
+                break;
+            }
+        }
+        return total;
+    }
+
+    /**
+     * Start reading a new body from the same source.
+     */
+    void reset() {
+        remaining = 0;
+        started = false;
+        finished = false;
+    }
+
+    /**
+     * True once the last (empty) chunk and the trailer were read.
+     */
+    bool atEnd() const {
+        return finished;
+    }
+
+private:
+    Source &source;
+    size_t remaining;
+    bool started;
+    bool finished;
+
+    /**
+     * Read the next chunk size line, skipping the CRLF that ends the previous chunk.
+     */
+    bool nextChunk() {
+        if (finished) {
+            return false;
+        }
+        if (started) {
+            uint8_t crlf[2];
+            if (source.readBytes(crlf, sizeof(crlf)) != sizeof(crlf)) {
+                return false;
+            }
+        }
+        started = true;
+
+        size_t size = 0;
+        bool inExtension = false;
+        bool digits = false;
+        for (;;) {
+            uint8_t c;
+            if (source.readBytes(&c, 1) != 1) {
+                return false;
+            }
+            if (c == '\n') {
+                break;
+            }
+            if (inExtension || c == '\r') {
+                continue;
+            }
+            if (c == ';') {
+                inExtension = true;
+            } else if (c >= '0' && c <= '9') {
+                size = size * 16 + (c - '0');
+                digits = true;
+            } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                size = size * 16 + ((c | 0x20) - 'a' + 10);
+                digits = true;
+            } else {
+                return false;
+            }
+        }
+        if (!digits) {
+            return false;
+        }
+        if (size == 0) {
+            // Consume the trailer, so a kept-alive connection is left at the next response.
+            finished = skipTrailer();
+            return false;
+        }
+        remaining = size;
+        return true;
+    }
+
+    /**
+     * Skip the trailer fields after the last chunk, up to and including the empty line.
+     */
+    bool skipTrailer() {
+        size_t lineLength = 0;
+        for (;;) {
+            uint8_t c;
+            if (source.readBytes(&c, 1) != 1) {
+                return false;
+            }
+            if (c == '\n') {
+                if (lineLength == 0) {
+                    return true;
+                }
+                lineLength = 0;
+            } else if (c != '\r') {
+                lineLength++;
+            }
+        }
+    }
+};
+
+#endif // HTTP_CHUNKED_H
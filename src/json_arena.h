@@ -0,0 +1,115 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <ArduinoJson.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * An ArduinoJson allocator on a fixed buffer, so parsing a response or formatting an event does
+ * not touch the heap.
+ *
+ * Blocks are taken from the buffer in order. Freeing the last block gives its space back, and the
+ * whole buffer is free again once all blocks are: after every JsonDocument that used it. When the
+ * buffer is full the heap is used instead, and counted. One JsonDocument at a time, on one task.
+ */
+template<size_t Size>
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    JsonArena() : top(0), live(0), fallbacks(0) {
+    }
+
+    /**
+     * A copy starts empty, blocks of the original are not valid in it. Lets arrays of owners be initialized by value.
+     */
+    JsonArena(const JsonArena &) : JsonArena() {
+    }
+
+    JsonArena &operator=(const JsonArena &) = delete;
+
+    void *allocate(const size_t size) override {
+        const size_t needed = HEADER + aligned(size);
+        if (top + needed > Size) {
+            fallbacks++;
+            return malloc(size);
+        }
+        uint8_t *block = buffer + top;
+        memcpy(block, &size, sizeof(size));
+        top += needed;
+        live++;
+        return block + HEADER;
+    }
+
+    void deallocate(void *pointer) override {
+        if (!owns(pointer)) {
+            free(pointer);
+            return;
+        }
+        uint8_t *block = static_cast<uint8_t *>(pointer) - HEADER;
+        if (block + HEADER + aligned(blockSize(block)) == buffer + top) {
+            top = static_cast<size_t>(block - buffer);
+        }
+        if (--live == 0) {
+            top = 0;
+        }
+    }
+
+    void *reallocate(void *pointer, const size_t size) override {
+        if (pointer == nullptr) {
+            return allocate(size);
+        }
+        if (!owns(pointer)) {
+            return realloc(pointer, size);
+        }
+        uint8_t *block = static_cast<uint8_t *>(pointer) - HEADER;
+        const size_t oldSize = blockSize(block);
+        const size_t offset = static_cast<size_t>(block - buffer);
+        // The last block grows or shrinks in place.
+        if (block + HEADER + aligned(oldSize) == buffer + top && offset + HEADER + aligned(size) <= Size) {
+            memcpy(block, &size, sizeof(size));
+            top = offset + HEADER + aligned(size);
+            return pointer;
+        }
+        void *moved = allocate(size);
+        if (moved != nullptr) {
+            memcpy(moved, pointer, oldSize < size ? oldSize : size);
+            deallocate(pointer);
+        }
+        return moved;
+    }
+
+    /**
+     * @return The allocations that did not fit and went to the heap. Safe from any task.
+     */
+    uint32_t getFallbacks() const {
+        return fallbacks.load();
+    }
+
+private:
+    // The size of a block is in front of it, padded to keep the block aligned.
+    static const size_t HEADER = 8;
+
+    alignas(8) uint8_t buffer[Size];
+    size_t top;
+    size_t live;
+    std::atomic<uint32_t> fallbacks;
+
+    static size_t aligned(const size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    static size_t blockSize(const uint8_t *block) {
+        size_t size;
+        memcpy(&size, block, sizeof(size));
+        return size;
+    }
+
+    bool owns(const void *pointer) const {
+        return pointer >= buffer && pointer < buffer + Size;
+    }
+};
+
+#endif // JSON_ARENA_H
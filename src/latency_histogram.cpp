@@ -0,0 +1,55 @@
+#include "latency_histogram.h"
+
+const uint32_t LatencyHistogram::BOUNDS[LATENCY_HISTOGRAM_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000
+};
+
+uint32_t LatencySummary::percentile(const float fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    // The rank of the sample, from 1.
+    uint32_t rank = static_cast<uint32_t>(fraction * static_cast<float>(count) + 0.5f);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return LatencyHistogram::BOUNDS[i] < max ? LatencyHistogram::BOUNDS[i] : max;
+        }
+    }
+    return max;
+}
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0), buckets() {
+    for (auto &bucket: buckets) {
+        bucket.store(0);
+    }
+}
+
+void LatencyHistogram::record(const uint32_t us) {
+    size_t bucket = 0;
+    while (bucket < LATENCY_HISTOGRAM_BUCKETS - 1 && us > BOUNDS[bucket]) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(us, std::memory_order_relaxed);
+    uint32_t previous = max.load(std::memory_order_relaxed);
+    while (us > previous && !max.compare_exchange_weak(previous, us, std::memory_order_relaxed)) {
+    }
+    // Last, so a summary never has more samples than the buckets hold.
+    count.fetch_add(1, std::memory_order_release);
+}
+
+LatencySummary LatencyHistogram::getSummary() const {
+    LatencySummary summary;
+    summary.count = count.load(std::memory_order_acquire);
+    summary.sum = sum.load(std::memory_order_relaxed);
+    summary.max = max.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        summary.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    return summary;
+}
@@ -0,0 +1,56 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// The last bucket counts everything above the highest bound.
+#define LATENCY_HISTOGRAM_BUCKETS 16
+
+/**
+ * A copy of the histogram, consistent enough for reporting.
+ */
+struct LatencySummary {
+    uint32_t count;
+    // In µs.
+    uint64_t sum;
+    uint32_t max;
+    // Per bucket, not cumulative.
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+
+    /**
+     * @param fraction 0.5 for the median.
+     * @return The upper bound of the bucket that holds the fraction of the samples, in µs,
+     * never more than max. 0 without samples.
+     */
+    uint32_t percentile(float fraction) const;
+};
+
+/**
+ * Counts durations in buckets of 50, 100, 250, 500 µs and 1, 2, 5, 10, 20, ... 2000 ms.
+ *
+ * Lock-free, safe from any task.
+ */
+class LatencyHistogram {
+public:
+    // The inclusive upper bound of each bucket but the last, in µs.
+    static const uint32_t BOUNDS[LATENCY_HISTOGRAM_BUCKETS - 1];
+
+    LatencyHistogram();
+
+    /**
+     * @param us The duration in µs.
+     */
+    void record(uint32_t us);
+
+    LatencySummary getSummary() const;
+
+private:
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint32_t> max;
+    std::atomic<uint32_t> buckets[LATENCY_HISTOGRAM_BUCKETS];
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,95 @@
+#include "lcd_mirror.h"
+
+#include <cstring>
+
+static_assert(LCD_MIRROR_STRIP_PIXELS >= LCD_WIDTH * 4 * 4, "A strip must hold a source row at scale 4");
+
+bool LcdMirror::rowChanged(const LcdFrame &frame, const int row) const {
+    return !displayedFrameValid || memcmp(frame.pixels[row], displayedFrame.pixels[row], LCD_BYTES_PER_ROW) != 0;
+}
+
+uint32_t LcdMirror::waitForStrip() {
+    if (!dmaPending) {
+        return 0;
+    }
+    const uint32_t start = micros();
+    display.waitDma();
+    dmaPending = false;
+    return micros() - start;
+}
+
+uint32_t LcdMirror::pushStrip(const uint16_t *pixels, const uint32_t count) {
+    if (pushMode == LCD_PUSH_SYNC) {
+        const uint32_t start = micros();
+        display.pushPixels(pixels, count);
+        return micros() - start;
+    }
+    const uint32_t waited = waitForStrip();
+    display.pushPixelsDma(pixels, count);
+    dmaPending = true;
+    return waited;
+}
+
+void LcdMirror::draw(const LcdFrame &frame) {
+    constexpr int width = LCD_WIDTH;
+    constexpr int height = LCD_HEIGHT;
+    const int scale = blitter.scale;
+    const int lineWidth = width * scale;
+    // A source row, scaled in both directions.
+    const int rowPixels = lineWidth * scale;
+    const int rowsPerStrip = LCD_MIRROR_STRIP_PIXELS / rowPixels;
+
+    uint32_t waitUs = 0;
+    bool writing = false;
+    int row = 0;
+    while (row < height) {
+        if (!rowChanged(frame, row)) {
+            stats.rowsSkipped++;
+            row++;
+            continue;
+        }
+
+        // Collect the run of changed rows and push them in one address window.
+        int runEnd = row + 1;
+        while (runEnd < height && rowChanged(frame, runEnd)) {
+            runEnd++;
+        }
+
+        if (!writing) {
+            display.startWrite();
+            writing = true;
+        }
+        // The previous run must be out before the window moves.
+        waitUs += waitForStrip();
+        display.setAddrWindow(x, y + row * scale, lineWidth, (runEnd - row) * scale);
+
+        while (row < runEnd) {
+            // Draw into the strip that is not being sent.
+            uint16_t *strip = strips[nextStrip];
+            uint16_t *out = strip;
+            const int stripEnd = row + rowsPerStrip < runEnd ? row + rowsPerStrip : runEnd;
+            for (; row < stripEnd; ++row) {
+                blitter.expandRow(frame.pixels[row], width, out);
+                for (int i = 1; i < scale; ++i) {
+                    memcpy(out + i * lineWidth, out, lineWidth * sizeof(uint16_t));
+                }
+                out += rowPixels;
+                stats.rowsDrawn++;
+            }
+            waitUs += pushStrip(strip, static_cast<uint32_t>(out - strip));
+            nextStrip ^= 1;
+        }
+    }
+
+    if (writing) {
+        waitUs += waitForStrip();
+        display.endWrite();
+        stats.spiWaitUs += waitUs;
+        if (metrics != nullptr) {
+            metrics->record(STAGE_LCD_SPI_WAIT, waitUs);
+        }
+    }
+
+    displayedFrame = frame;
+    displayedFrameValid = true;
+}
@@ -0,0 +1,101 @@
+#ifndef LCD_MIRROR_H
+#define LCD_MIRROR_H
+
+#include <cstdint>
+
+#include "evse_state.h"
+#include "hal.h"
+#include "metrics.h"
+#include "mono_blitter.h"
+
+// Pixels per strip buffer, at least one source row at the largest scale.
+#define LCD_MIRROR_STRIP_PIXELS 4096
+
+enum LcdPushMode {
+    // Wait for every strip to be sent before drawing the next.
+    LCD_PUSH_SYNC,
+    // Send a strip with DMA while the next one is drawn.
+    LCD_PUSH_DMA
+};
+
+/**
+ * Rows pushed to the display versus rows skipped because they did not change.
+ */
+struct LcdMirrorStats {
+    uint32_t rowsDrawn;
+    uint32_t rowsSkipped;
+    // Waiting for the display to take the pixels, in µs. Only measured with metrics.
+    uint32_t spiWaitUs;
+};
+
+/**
+ * Draws the SmartEVSE LCD frames on the display, scaled by the blitter.
+ * Keeps the frame that is on the display, so only the rows that changed are pushed again.
+ *
+ * The changed rows are drawn into two strip buffers in turn: with LCD_PUSH_DMA one strip is drawn
+ * while the other is sent, so the CPU only waits for what the display has not taken yet.
+ */
+class LcdMirror {
+public:
+    /**
+     * @param blitter The MonoBlitter specialization for the scale and colors, see MonoBlitter::rowBlitter().
+     * @param metrics Receives the time spent waiting for the display. Optional.
+     */
+    LcdMirror(hal::Display &display, const int x, const int y, const RowBlitter &blitter,
+              const LcdPushMode pushMode = LCD_PUSH_DMA, Metrics *metrics = nullptr)
+        : display(display), x(x), y(y), blitter(blitter), pushMode(pushMode), metrics(metrics), displayedFrame(),
+          displayedFrameValid(false), stats(), strips(), nextStrip(0), dmaPending(false) {
+    }
+
+    void draw(const LcdFrame &frame);
+
+    /**
+     * Forget what is on the display, the next frame is drawn completely.
+     * Call this after drawing over the LCD mirror area.
+     */
+    void invalidate() {
+        displayedFrameValid = false;
+    }
+
+    const LcdMirrorStats &getStats() const {
+        return stats;
+    }
+
+private:
+    hal::Display &display;
+    const int x;
+    const int y;
+    const RowBlitter &blitter;
+    const LcdPushMode pushMode;
+    Metrics *metrics;
+    // The frame currently on the display.
+    LcdFrame displayedFrame;
+    bool displayedFrameValid;
+    LcdMirrorStats stats;
+    // In internal RAM, which DMA can read.
+    alignas(4) uint16_t strips[2][LCD_MIRROR_STRIP_PIXELS];
+    int nextStrip;
+    bool dmaPending;
+
+    bool rowChanged(const LcdFrame &frame, int row) const;
+
+    /**
+     * Send a drawn strip, into the current address window.
+     *
+     * @return The µs waited for the display.
+     */
+    uint32_t pushStrip(const uint16_t *pixels, uint32_t count);
+
+    /**
+     * Wait until the strip that is being sent with DMA is out.
+     *
+     * @return The µs waited for the display.
+     */
+    uint32_t waitForStrip();
+
+    uint32_t micros() {
+        return metrics != nullptr ? metrics->micros() : 0;
+    }
+};
+
+#endif // LCD_MIRROR_H
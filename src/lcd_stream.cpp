@@ -0,0 +1,155 @@
+#include "lcd_stream.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+
+static void putLe16(uint8_t *out, const uint16_t value) {
+    out[0] = value & 0xff;
+    out[1] = value >> 8;
+}
+
+static void putLe32(uint8_t *out, const uint32_t value) {
+    putLe16(out, value & 0xffff);
+    putLe16(out + 2, value >> 16);
+}
+
+size_t encodeLcdBmp(const LcdFrame &frame, uint8_t *out) {
+    static const uint32_t PIXEL_OFFSET = 14 + 40 + 8;
+    memset(out, 0, PIXEL_OFFSET);
+    // BITMAPFILEHEADER
+    out[0] = 'B';
+    out[1] = 'M';
+    putLe32(out + 2, LCD_BMP_SIZE);
+    putLe32(out + 10, PIXEL_OFFSET);
+    // BITMAPINFOHEADER, positive height: bottom-up.
+    putLe32(out + 14, 40);
+    putLe32(out + 18, LCD_WIDTH);
+    putLe32(out + 22, LCD_HEIGHT);
+    putLe16(out + 26, 1);
+    putLe16(out + 28, 1);
+    putLe32(out + 34, LCD_HEIGHT * LCD_BYTES_PER_ROW);
+    putLe32(out + 46, 2);
+    // Palette, BGRA: 0 is black, 1 is white.
+    memset(out + 58, 0xff, 3);
+
+    // Rows of 16 bytes are already 4-byte aligned.
+    uint8_t *rows = out + PIXEL_OFFSET;
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        memcpy(rows + (LCD_HEIGHT - 1 - y) * LCD_BYTES_PER_ROW, frame.pixels[y], LCD_BYTES_PER_ROW);
+    }
+    return LCD_BMP_SIZE;
+}
+
+size_t encodeLcdRle(const LcdFrame &frame, uint8_t *out) {
+    const uint8_t *pixels = &frame.pixels[0][0];
+    const size_t size = sizeof(frame.pixels);
+    size_t length = 0;
+    for (size_t i = 0; i < size;) {
+        const uint8_t value = pixels[i];
+        size_t count = 1;
+        while (i + count < size && count < 255 && pixels[i + count] == value) {
+            count++;
+        }
+        out[length++] = static_cast<uint8_t>(count);
+        out[length++] = value;
+        i += count;
+    }
+    return length;
+}
+
+static const char NO_CONTENT[] =
+        "HTTP/1.1 204 No Content\r\n"
+        "Cache-Control: no-store\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Expose-Headers: X-Frame-Sequence\r\n"
+        "X-Frame-Sequence: %u\r\n"
+        "\r\n";
+
+LcdStream::LcdStream(const SendFunction send, hal::Clock &clock, const uint32_t timeoutMs)
+    : send(send), clock(clock), timeoutMs(timeoutMs), lastRecord(), current(), waiters(), waiterCount(0),
+      body() {
+}
+
+bool LcdStream::publish(const LcdFrame &frame) {
+    if (!frame.valid || (lastRecord.sequence != 0 && memcmp(frame.pixels, lastRecord.frame.pixels,
+                                                            sizeof(frame.pixels)) == 0)) {
+        return false;
+    }
+    lastRecord.sequence++;
+    lastRecord.frame = frame;
+    records.back() = lastRecord;
+    records.publish();
+    return true;
+}
+
+bool LcdStream::update() {
+    if (!records.consume()) {
+        return false;
+    }
+    current = records.front();
+    return true;
+}
+
+bool LcdStream::request(const int fd, const LcdFormat format, const uint32_t after) {
+    update();
+    if (current.sequence != 0 && current.sequence != after) {
+        respond(fd, format);
+        return true;
+    }
+    if (waiterCount >= LCD_STREAM_MAX_WAITERS) {
+        LOG_PRINTF("==== LcdStream::request() too many waiting\n");
+        return false;
+    }
+    waiters[waiterCount++] = {fd, format, clock.millis()};
+    return true;
+}
+
+void LcdStream::cancel(const int fd) {
+    for (size_t i = 0; i < waiterCount; i++) {
+        if (waiters[i].fd == fd) {
+            waiters[i] = waiters[--waiterCount];
+            return;
+        }
+    }
+}
+
+void LcdStream::flush() {
+    const bool updated = update();
+    for (size_t i = 0; i < waiterCount;) {
+        if (updated) {
+            respond(waiters[i].fd, waiters[i].format);
+        } else if (clock.millis() - waiters[i].since >= timeoutMs) {
+            char header[sizeof(NO_CONTENT) + 8];
+            const int length = snprintf(header, sizeof(header), NO_CONTENT, static_cast<unsigned>(current.sequence));
+            send(waiters[i].fd, header, static_cast<size_t>(length));
+        } else {
+            i++;
+            continue;
+        }
+        waiters[i] = waiters[--waiterCount];
+    }
+}
+
+bool LcdStream::respond(const int fd, const LcdFormat format) {
+    static_assert(LCD_BMP_SIZE <= LCD_RLE_MAX_SIZE, "The body buffer must hold a BMP");
+    const size_t bodyLength = format == LCD_FORMAT_BMP ? encodeLcdBmp(current.frame, body)
+                                                       : encodeLcdRle(current.frame, body);
+    char header[256];
+    const int headerLength =
+            snprintf(header, sizeof(header),
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %u\r\n"
+                     "Cache-Control: no-store\r\n"
+                     "Access-Control-Allow-Origin: *\r\n"
+                     "Access-Control-Expose-Headers: X-Frame-Sequence\r\n"
+                     "X-Frame-Sequence: %u\r\n"
+                     "\r\n",
+                     format == LCD_FORMAT_BMP ? "image/bmp" : "application/octet-stream",
+                     static_cast<unsigned>(bodyLength), static_cast<unsigned>(current.sequence));
+    // The send function has the web server close the socket when it fails.
+    return send(fd, header, static_cast<size_t>(headerLength)) >= 0 &&
+           send(fd, reinterpret_cast<const char *>(body), bodyLength) >= 0;
+}
@@ -0,0 +1,146 @@
+#ifndef LCD_STREAM_H
+#define LCD_STREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "evse_state.h"
+#include "hal.h"
+#include "triple_buffer.h"
+
+// Web clients waiting for the next frame at the same time.
+#define LCD_STREAM_MAX_WAITERS 4
+// A BMP of the LCD: file header, info header, 2 color palette and the rows.
+#define LCD_BMP_SIZE (14 + 40 + 8 + LCD_HEIGHT * LCD_BYTES_PER_ROW)
+// Run-length encoding of the rows, at most a (count, value) pair per byte.
+#define LCD_RLE_MAX_SIZE (2 * LCD_HEIGHT * LCD_BYTES_PER_ROW)
+
+enum LcdFormat {
+    // image/bmp, 1 bit per pixel, browsers show it as is.
+    LCD_FORMAT_BMP,
+    // (count, byte) pairs over the rows, top to bottom, 16 bytes per row, most significant bit left, 1 is lit.
+    LCD_FORMAT_RLE
+};
+
+/**
+ * A frame of the SmartEVSE LCD, numbered in the order the frames changed.
+ */
+struct LcdRecord {
+    uint32_t sequence;
+    LcdFrame frame;
+};
+
+/**
+ * The last frame of the SmartEVSE LCD for /api/lcd, with long-polling for the next one.
+ *
+ * The UI publishes every frame it receives, only frames that differ from the previous one get a
+ * new sequence number. Clients ask for the frame after the sequence number they have, the request
+ * is parked until there is one. The sockets belong to the web server task, like in EventStream,
+ * so request(), cancel() and flush() run there.
+ */
+class LcdStream {
+public:
+    /**
+     * Write to a client socket.
+     *
+     * @return The number of bytes written, negative if the socket failed.
+     */
+    typedef int (*SendFunction)(int fd, const char *data, size_t length);
+
+    /**
+     * @param timeoutMs A parked request gets "204 No Content" after this long, clients then ask again.
+     */
+    LcdStream(SendFunction send, hal::Clock &clock, uint32_t timeoutMs);
+
+    // ---- UI ----
+
+    /**
+     * Publish a frame received from the SmartEVSE. Invalid frames are ignored, the last good one is kept.
+     *
+     * @return True if the frame differs from the previous one and needs a flush().
+     */
+    bool publish(const LcdFrame &frame);
+
+    // ---- Web server task ----
+
+    /**
+     * Answer a request for the frame after sequence number after, now if there is one, otherwise
+     * when the next frame arrives or the request times out.
+     *
+     * @param after The sequence number the client has, 0 for none.
+     * @return False if the request can not be parked because there are too many waiting.
+     */
+    bool request(int fd, LcdFormat format, uint32_t after);
+
+    /**
+     * Forget a parked request, call this when its socket is closed.
+     */
+    void cancel(int fd);
+
+    /**
+     * Send a new frame to the parked requests, and time out the ones that waited too long.
+     */
+    void flush();
+
+    uint32_t getSequence() const {
+        return current.sequence;
+    }
+
+    /**
+     * Safe from any task, so the UI knows when flush() has requests to time out.
+     */
+    size_t getWaiterCount() const {
+        return waiterCount.load();
+    }
+
+private:
+    struct Waiter {
+        int fd;
+        LcdFormat format;
+        uint32_t since;
+    };
+
+    SendFunction send;
+    hal::Clock &clock;
+    const uint32_t timeoutMs;
+    TripleBuffer<LcdRecord> records;
+
+    // Owned by the UI.
+    LcdRecord lastRecord;
+
+    // Owned by the web server task.
+    LcdRecord current;
+    Waiter waiters[LCD_STREAM_MAX_WAITERS];
+    // Also read by getWaiterCount().
+    std::atomic<size_t> waiterCount;
+    // The largest response body, kept off the web server task's stack.
+    uint8_t body[LCD_RLE_MAX_SIZE];
+
+    /**
+     * Take the newest frame from the UI.
+     *
+     * @return True if there was one.
+     */
+    bool update();
+
+    bool respond(int fd, LcdFormat format);
+};
+
+/**
+ * Encode a frame as a BMP file.
+ *
+ * @param out Room for LCD_BMP_SIZE bytes.
+ * @return The size of the file.
+ */
+size_t encodeLcdBmp(const LcdFrame &frame, uint8_t *out);
+
+/**
+ * Run-length encode a frame, see LCD_FORMAT_RLE.
+ *
+ * @param out Room for LCD_RLE_MAX_SIZE bytes.
+ * @return The encoded size.
+ */
+size_t encodeLcdRle(const LcdFrame &frame, uint8_t *out);
+
+#endif // LCD_STREAM_H
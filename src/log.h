@@ -0,0 +1,13 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Serial logging on the device, stdout on the native build.
+#ifdef ARDUINO
+#include <Arduino.h>
+#define LOG_PRINTF(...) Serial.printf(__VA_ARGS__)
+#else
+#include <cstdio>
+#define LOG_PRINTF(...) std::printf(__VA_ARGS__)
+#endif
+
+#endif // LOG_H
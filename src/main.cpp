@@ -1,10 +1,11 @@
 #include <M5Unified.h>
 #include <Arduino.h>
 #include <WiFi.h>
-#include <HTTPClient.h>
-#include <Preferences.h>
 #include <ArduinoJson.h>
+#include <atomic>
+#include <cassert>
 #include <map>
+#include <mutex>
 
 #include "esp_wifi.h"
 #include "esp_http_server.h"
@@ -12,8 +13,23 @@
 #include <utility>
 #include <ESPmDNS.h>
 #include <qrcode.h>
+#include <unistd.h>
 #include <DNSServer.h>
 
+#include "event_stream.h"
+#include "evse_client.h"
+#include "evse_fleet.h"
+#include "evse_poller.h"
+#include "evse_state.h"
+#include "hal_esp32.h"
+#include "lcd_mirror.h"
+#include "lcd_stream.h"
+#include "mdns_browser.h"
+#include "metrics.h"
+#include "mono_blitter.h"
+#include "settings_cache.h"
+#include "widget.h"
+
 // The included functions are in a C file.
 extern "C" {
 const char *mg_unlist(size_t no);
@@ -23,11 +39,20 @@ const char *mg_unpack(const char *name, size_t *size, time_t *mtime);
 struct packed_file {
     const char *name;
     const unsigned char *data;
+    // Including a terminating zero.
     size_t size;
     time_t mtime;
+    // Quoted content hash, a strong ETag.
+    const char *etag;
+    // Content-Type.
+    const char *mime;
+    // The gzipped copy, if it is smaller.
+    const packed_file *gzip;
 };
 
 extern const packed_file packed_files[];
+
+const packed_file *mg_unpack_file(const char *name);
 }
 
 #define WIFI_SSID "SmartEVSE_Display"
@@ -42,6 +67,15 @@ extern const packed_file packed_files[];
 #define SOLAR_BUTTON_X 16
 #define SMART_BUTTON_X 176
 
+// Status bar dimensions and positions, below the buttons
+#define SCREEN_WIDTH 320
+#define FLEET_Y 184
+#define FLEET_HEIGHT 20
+#define STATUS_Y 204
+#define STATUS_HEIGHT 20
+#define ERROR_Y 224
+#define ERROR_HEIGHT 16
+
 // Colors
 #define ACTIVE_BORDER_COLOR TFT_WHITE
 #define TEXT_COLOR TFT_WHITE
@@ -52,7 +86,15 @@ extern const packed_file packed_files[];
 #define BOLD_FONT &fonts::FreeSansBold12pt7b
 
 const String DEVICE_NAME = "smartevse-display";
+// The units to poll, see formatTargetList().
+const String PREFERENCES_KEY_EVSE_HOSTS = "smartevse_hosts";
+// The single unit saved by older firmware, read once to fill the list.
 const String PREFERENCES_KEY_EVSE_HOST = "smartevse_host";
+const String PREFERENCES_KEY_EVSE_IP = "smartevse_ip";
+const String PREFERENCES_KEY_EVSE_PORT = "smartevse_port";
+const String PREFERENCES_KEY_SETTINGS_TTL = "settings_ttl";
+// The polling intervals, see parsePollRates().
+const String PREFERENCES_KEY_POLL_RATES = "poll_rates";
 const String PREFERENCES_KEY_WIFI_SSID = "ssid";
 const String PREFERENCES_KEY_WIFI_PASSWORD = "password";
 
@@ -64,11 +106,18 @@ String AP_HOSTNAME;
 IPAddress apIP(192, 168, 4, 1); // Local IP of the ESP32
 IPAddress subnet(255, 255, 255, 0);
 
-Preferences preferences;
-String smartEvseHost;
-
-// EVSE connected
-bool evseConnected = false;
+EspStorage storage;
+// The SmartEVSE units to poll, with their last known addresses so requests don't need an mDNS lookup.
+EvseTarget evseTargets[EVSE_MAX_UNITS];
+size_t evseTargetCount = 0;
+// How long /api/evse/settings serves a cached body, in ms. The poller's normal interval by default,
+// so the proxy only adds requests of its own while the poller is idle.
+uint32_t settingsTtl = 3000;
+
+// EVSE connected, the touch task reads it too.
+std::atomic<bool> evseConnected(false);
+// The circuit breakers of the SmartEVSE on screen, see EvseSnapshot::breaker.
+BreakerState evseBreaker = BREAKER_CLOSED;
 // WiFi connected
 bool wifiConnected = false;
 // Show config (SmartEVSE selection screen).
@@ -77,14 +126,114 @@ bool dnsServerRunning = false;
 bool reboot = false;
 
 // Global variables.
-String evseState = "Not Connected";
+// Interned, see internEvseState().
+const char *evseState = "Not Connected";
 // The mode, either Solar or Smart.
-String mode = "Solar";
+EvseMode mode = EVSE_MODE_SOLAR;
 int chargeCurrent = 0;
 int gridCurrent = 0;
-String error = "None";
+EvseError error = EVSE_ERROR_NONE;
+
+// Network task, pinned to the core the WiFi stack runs on.
+constexpr uint32_t NETWORK_TASK_STACK_SIZE = 8192;
+constexpr BaseType_t NETWORK_TASK_CORE = 0;
+// One network task per unit, started when the unit is first used.
+TaskHandle_t networkTaskHandles[EVSE_MAX_UNITS] = {};
+constexpr uint32_t DISCOVERY_TASK_STACK_SIZE = 4096;
+TaskHandle_t discoveryTaskHandle = nullptr;
+// Decode task, next to the network tasks so the core of loop() only renders. Woken when an LCD was fetched.
+constexpr uint32_t DECODE_TASK_STACK_SIZE = 4096;
+constexpr uint32_t DECODE_TASK_TIMEOUT = 100;
+TaskHandle_t decodeTaskHandle = nullptr;
+// Touch task, above loop() on the same core so a press is answered while loop() is drawing.
+constexpr uint32_t TOUCH_TASK_STACK_SIZE = 4096;
+constexpr UBaseType_t TOUCH_TASK_PRIORITY = 5;
+constexpr BaseType_t TOUCH_TASK_CORE = 1;
+constexpr uint32_t TOUCH_SAMPLE_INTERVAL = 10;
+TaskHandle_t touchTaskHandle = nullptr;
+
+enum TouchAction {
+    TOUCH_SOLAR,
+    TOUCH_SMART,
+    TOUCH_CONFIG,
+    TOUCH_SWIPE_NEXT,
+    TOUCH_SWIPE_PREVIOUS
+};
+
+/**
+ * What the touch task asks loop() to do, after it gave the feedback.
+ */
+struct TouchEvent {
+    TouchAction action;
+    // micros() when the touch was detected.
+    uint32_t detectedAt;
+};
+
+constexpr UBaseType_t TOUCH_EVENT_QUEUE_LENGTH = 8;
+QueueHandle_t touchEvents = nullptr;
+// Held while drawing, by loop() and the touch task.
+std::mutex displayMutex;
+// Held while reading the touch screen, by the touch task and the device selection screen.
+std::mutex touchMutex;
+
+EspClock espClock;
+EspDisplay espDisplay;
+EspDiscovery discovery;
+// Where the time goes, for /api/metrics.
+Metrics metrics(espClock);
+// The last /settings body of the first unit, for /api/evse/settings.
+SettingsCache settingsCache(espClock);
+// A connection, client and poller per unit, so a unit that does not answer only delays itself.
+static_assert(EVSE_MAX_UNITS == 4, "One initializer per unit");
+EspHttpClient evseHttpClients[EVSE_MAX_UNITS] = {{&metrics}, {&metrics}, {&metrics}, {&metrics}};
+EvseClient evseClients[EVSE_MAX_UNITS] = {
+    EvseClient(evseHttpClients[0], &settingsCache, &metrics), EvseClient(evseHttpClients[1], nullptr, &metrics),
+    EvseClient(evseHttpClients[2], nullptr, &metrics), EvseClient(evseHttpClients[3], nullptr, &metrics)
+};
+// Poll the units on the network tasks and hand the results to the UI.
+EvsePoller evsePollers[EVSE_MAX_UNITS] = {
+    {evseClients[0], espClock, discovery}, {evseClients[1], espClock, discovery},
+    {evseClients[2], espClock, discovery}, {evseClients[3], espClock, discovery}
+};
+EvsePoller *const evsePollerList[EVSE_MAX_UNITS] = {&evsePollers[0], &evsePollers[1], &evsePollers[2], &evsePollers[3]};
+EvseFleet evseFleet(evsePollerList);
+// Browses for SmartEVSE devices on the discovery task.
+MdnsBrowser mdnsBrowser(discovery, espClock, "SmartEVSE-");
+// The SmartEVSE LCD at twice its size, white on black.
+typedef MonoBlitter<2, BIT_ORDER_MSB_FIRST, TFT_WHITE, TFT_BLACK> MirrorBlitter;
+// Build with -DLCD_MIRROR_SYNC_PUSH to compare lcd_spi_wait in /api/metrics with the push that waits for every strip.
+#ifdef LCD_MIRROR_SYNC_PUSH
+constexpr LcdPushMode LCD_PUSH_MODE = LCD_PUSH_SYNC;
+#else
+constexpr LcdPushMode LCD_PUSH_MODE = LCD_PUSH_DMA;
+#endif
+LcdMirror lcdMirror(espDisplay, 32, 0, MirrorBlitter::rowBlitter(), LCD_PUSH_MODE, &metrics);
+
+httpd_handle_t webServer = nullptr;
+// Events or frames were published, wake the web server after the loop() iteration.
+bool webFlushPending = false;
+// Heap allocations in loop() iterations that only rendered polled state, see checkSteadyState().
+std::atomic<uint32_t> steadyStateAllocations(0);
+
+/**
+ * Write to a socket of the web server, closing it when that fails. Runs on the web server task.
+ */
+int sendToWebClient(const int fd, const char *data, const size_t length) {
+    const int sent = httpd_socket_send(webServer, fd, data, length, 0);
+    if (sent < 0) {
+        httpd_sess_trigger_close(webServer, fd);
+    }
+    return sent;
+}
 
-HTTPClient *smartEvseHttpClient = nullptr;
+// The web clients following /api/events.
+EventStream eventStream(sendToWebClient);
+constexpr unsigned long EVENT_PING_INTERVAL = 15000;
+// The web clients following /api/lcd. A long-poll is answered with "204 No Content" after this long.
+constexpr uint32_t LCD_LONG_POLL_TIMEOUT = 20000;
+LcdStream lcdStream(sendToWebClient, espClock, LCD_LONG_POLL_TIMEOUT);
+// How often waiting long-polls are checked for the timeout, also while no frames arrive.
+constexpr unsigned long LCD_LONG_POLL_CHECK_INTERVAL = 1000;
 
 struct WifiNetwork { // NOLINT(*-pro-type-member-init)
     String ssid;
@@ -101,33 +250,145 @@ struct MDNSHost {
 
 DNSServer dnsServer;
 
-// Button objects
+// Button objects, for the touch input. The buttons are drawn by their widgets.
 LGFX_Button solarButton;
 LGFX_Button smartButton;
 LGFX_Button configButton;
 
+// Bound to the mode widget while the SmartEVSE is not connected.
+constexpr uint32_t MODE_WIDGET_NONE = 0xff;
+// The bits of the value bound to a button widget.
+constexpr uint32_t BUTTON_WIDGET_ACTIVE = 1;
+constexpr uint32_t BUTTON_WIDGET_PRESSED = 2;
+
+void drawWifiWidget(M5Canvas &canvas, const uint32_t connected) {
+    canvas.fillSprite(BACKGROUND_COLOR);
+    canvas.setTextSize(2);
+    canvas.setTextColor(TFT_LIGHTGRAY);
+    canvas.setCursor(16, 0);
+    canvas.print("WIFI");
+    canvas.fillCircle(76, 6, 5, connected ? TFT_GREEN : TFT_RED);
+}
+
+void drawEvseWidget(M5Canvas &canvas, const uint32_t color) {
+    canvas.fillSprite(BACKGROUND_COLOR);
+    canvas.setTextSize(2);
+    canvas.setTextColor(TFT_LIGHTGRAY);
+    canvas.setCursor(8, 0);
+    canvas.print("EVSE ");
+    canvas.fillCircle(68, 6, 5, color);
+}
+
+void drawModeWidget(M5Canvas &canvas, const uint32_t mode) {
+    canvas.fillSprite(BACKGROUND_COLOR);
+    canvas.setTextSize(2);
+    canvas.setTextColor(TFT_LIGHTGRAY);
+    canvas.setCursor(8, 0);
+    canvas.print("Mode:");
+    canvas.print(mode == MODE_WIDGET_NONE ? "-" : modeName(static_cast<EvseMode>(mode)));
+}
+
+void drawErrorWidget(M5Canvas &canvas, const uint32_t error) {
+    const EvseError evseError = static_cast<EvseError>(error);
+    canvas.fillSprite(BACKGROUND_COLOR);
+    canvas.setTextSize(2);
+    canvas.setTextColor(evseError == EVSE_ERROR_NONE ? TFT_DARKGRAY : TFT_RED);
+    canvas.setCursor(16, 0);
+    canvas.print("Error: ");
+    canvas.print(evseError == EVSE_ERROR_NONE ? "None" : errorMessage(evseError));
+}
+
+// The fleet status line as drawFleetStatus() formatted it, empty with only one unit. A changed line
+// bumps fleetStatusVersion, the value bound to its widget.
+char fleetStatusLine[48] = "";
+bool fleetStatusComplete = true;
+uint32_t fleetStatusVersion = 0;
+
+void drawFleetWidget(M5Canvas &canvas, const uint32_t) {
+    canvas.fillSprite(BACKGROUND_COLOR);
+    if (fleetStatusLine[0] == '\0') {
+        return;
+    }
+    canvas.setTextSize(2);
+    canvas.setTextColor(fleetStatusComplete ? TFT_LIGHTGRAY : TFT_ORANGE);
+    canvas.setCursor(16, 2);
+    canvas.print(fleetStatusLine);
+}
+
 /**
- * Scans for available WiFi networks and retrieves their details.
- *
- * @return A vector of WifiNetwork objects, each containing information
- *         about an available WiFi network, sorted by signal strength
- *         in ascending order.
+ * Draw a button over the whole sprite, the way LGFX_Button draws it on the display.
  */
-static std::vector<WifiNetwork> cached_networks;
-static unsigned long last_scan_time = 0;
+void drawButtonWidget(M5Canvas &canvas, const uint32_t value, const uint16_t fillColor, const char *label) {
+    const int width = canvas.width();
+    const int height = canvas.height();
+    LGFX_Button button;
+    button.initButton(&canvas, static_cast<int16_t>(width / 2), static_cast<int16_t>(height / 2),
+                      static_cast<uint16_t>(width), static_cast<uint16_t>(height),
+                      (value & BUTTON_WIDGET_ACTIVE) != 0 ? ACTIVE_BORDER_COLOR : BACKGROUND_COLOR, fillColor,
+                      TFT_BLACK, label, 3);
+    canvas.fillSprite(BACKGROUND_COLOR);
+    button.drawButton((value & BUTTON_WIDGET_PRESSED) != 0);
+}
+
+void drawSolarWidget(M5Canvas &canvas, const uint32_t value) {
+    drawButtonWidget(canvas, value, 0xF680, "Solar");
+}
+
+void drawSmartWidget(M5Canvas &canvas, const uint32_t value) {
+    drawButtonWidget(canvas, value, 0x07E0, "Smart");
+}
+
+void drawConfigWidget(M5Canvas &canvas, const uint32_t value) {
+    drawButtonWidget(canvas, value, TFT_RED, "Select EVSE");
+}
+
+// The status bar and the buttons, each on its own sprite, only drawn and pushed when what they show changed.
+SpriteWidget wifiWidget(0, STATUS_Y, 92, STATUS_HEIGHT, drawWifiWidget);
+SpriteWidget evseWidget(92, STATUS_Y, 84, STATUS_HEIGHT, drawEvseWidget);
+SpriteWidget modeWidget(176, STATUS_Y, SCREEN_WIDTH - 176, STATUS_HEIGHT, drawModeWidget);
+SpriteWidget errorWidget(0, ERROR_Y, SCREEN_WIDTH, ERROR_HEIGHT, drawErrorWidget);
+SpriteWidget fleetWidget(0, FLEET_Y, SCREEN_WIDTH, FLEET_HEIGHT, drawFleetWidget);
+SpriteWidget solarWidget(SOLAR_BUTTON_X, BUTTON_Y, BUTTON_WIDTH, BUTTON_HEIGHT, drawSolarWidget);
+SpriteWidget smartWidget(SMART_BUTTON_X, BUTTON_Y, BUTTON_WIDTH, BUTTON_HEIGHT, drawSmartWidget);
+SpriteWidget configWidget(SOLAR_BUTTON_X, BUTTON_Y, SCREEN_WIDTH - 2 * SOLAR_BUTTON_X, BUTTON_HEIGHT,
+                          drawConfigWidget);
+// Guarded by displayMutex, like the display.
+Compositor compositor(espClock);
+
+// The networks found by the last completed scan, guarded by wifiScanMutex.
+// The web server reads them, loop() replaces them.
+static std::mutex wifiScanMutex;
+static std::vector<WifiNetwork> cachedNetworks;
+// millis() when the last scan completed, 0 before the first scan.
+static unsigned long lastScanTime = 0;
+static std::atomic<bool> wifiScanRequested(false);
+static std::atomic<bool> wifiScanRunning(false);
 constexpr unsigned long SCAN_INTERVAL = 30000;
 
-std::vector<WifiNetwork> scanWifiNetworks() {
-    unsigned long current_time = millis();
+/**
+ * Drive the asynchronous WiFi scan: start it when requested, collect the results when done.
+ * Called from loop(), so only the UI task uses the WiFi scan API.
+ */
+void updateWifiScan() {
+    if (!wifiScanRunning) {
+        if (wifiScanRequested.exchange(false)) {
+            Serial.printf("==== updateWifiScan() starting scan\n");
+            wifiScanRunning = WiFi.scanNetworks(true) == WIFI_SCAN_RUNNING;
+        }
+        return;
+    }
 
-    if (last_scan_time != 0 && current_time - last_scan_time < SCAN_INTERVAL) {
-        return cached_networks;
+    const int n = WiFi.scanComplete();
+    if (n == WIFI_SCAN_RUNNING) {
+        return;
+    }
+    wifiScanRunning = false;
+    if (n < 0) {
+        Serial.printf("==== updateWifiScan() scan failed: %d\n", n);
+        return;
     }
-    last_scan_time = current_time;
 
-    const int n = WiFi.scanNetworks();
     std::vector<WifiNetwork> networks;
-
     for (int i = 0; i < n; ++i) {
         WifiNetwork network = {
             WiFi.SSID(i),
@@ -136,6 +397,7 @@ std::vector<WifiNetwork> scanWifiNetworks() {
         };
         networks.push_back(network);
     }
+    WiFi.scanDelete();
 
     // Remove duplicates, keep strongest signal
     std::map<String, WifiNetwork> unique_networks;
@@ -157,77 +419,247 @@ std::vector<WifiNetwork> scanWifiNetworks() {
                   return a.rssi > b.rssi;
               });
 
-    cached_networks = networks;
-    return networks;
+    std::lock_guard<std::mutex> lock(wifiScanMutex);
+    cachedNetworks.swap(networks);
+    lastScanTime = millis();
 }
 
-static std::vector<MDNSHost> cachedMdnsHosts;
-static unsigned long lastMdnsQuery = 0;
-constexpr unsigned long MDNS_QUERY_INTERVAL = 30000;
-
+/**
+ * The SmartEVSE devices found so far. Starts a background browse when the list is stale,
+ * it never waits for one.
+ *
+ * @param forceFreshList Browse again, even if the list is recent.
+ */
 std::vector<MDNSHost> discoverMDNS(const bool forceFreshList = false) {
-    const unsigned long currentTime = millis();
+    mdnsBrowser.request(forceFreshList);
 
-    if (!forceFreshList && lastMdnsQuery != 0 && currentTime - lastMdnsQuery < MDNS_QUERY_INTERVAL) {
-        return cachedMdnsHosts;
+    hal::DiscoveredHost found[MDNS_BROWSER_MAX_HOSTS];
+    const size_t n = mdnsBrowser.getHosts(found, MDNS_BROWSER_MAX_HOSTS);
+    std::vector<MDNSHost> hosts;
+    for (size_t i = 0; i < n; i++) {
+        const String hostname = found[i].host;
+        const String serial = hostname.substring(hostname.indexOf("-") + 1);
+        hosts.push_back({
+            hostname,
+            serial,
+            found[i].ip,
+            found[i].port
+        });
     }
-    lastMdnsQuery = currentTime;
+    return hosts;
+}
 
-    std::vector<MDNSHost> hosts;
-    int retryCount = 3;
-
-    while (retryCount > 0) {
-        const int n = MDNS.queryService("http", "tcp");
-        if (n > 0) {
-            for (int i = 0; i < n; i++) {
-                const String hostname = MDNS.hostname(i);
-                // Only include SmartEVSE hosts.
-                if (!hostname.startsWith("SmartEVSE-")) {
-                    continue;
-                }
-                bool exists = false;
-                for (auto &host: hosts) {
-                    if (host.host == hostname) {
-                        exists = true;
-                        break;
-                    }
-                }
-                if (!exists) {
-                    const String serial = hostname.substring(hostname.indexOf("-") + 1);
-                    hosts.push_back({
-                        hostname,
-                        serial,
-                        MDNS.IP(i).toString(),
-                        MDNS.port(i)
-                    });
-                }
-            }
+/**
+ * The SmartEVSE LCD as last received: /api/lcd?format=bmp|rle&after=<sequence>.
+ *
+ * With after, the request waits for the frame that follows it, the X-Frame-Sequence header of
+ * every response is the after of the next request. The response is written to the socket by
+ * lcdStream, now or when the frame arrives.
+ */
+esp_err_t sendLcdFrame(httpd_req_t *req) {
+    char query[64] = "";
+    char value[16];
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    const LcdFormat format =
+            httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK && strcmp(value, "rle") == 0
+                ? LCD_FORMAT_RLE
+                : LCD_FORMAT_BMP;
+    const uint32_t after = httpd_query_key_value(query, "after", value, sizeof(value)) == ESP_OK
+                               ? static_cast<uint32_t>(strtoul(value, nullptr, 10))
+                               : 0;
+    if (!lcdStream.request(httpd_req_to_sockfd(req), format, after)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_send(req, "Too many clients", HTTPD_RESP_USE_STRLEN);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Proxy the /settings of the first SmartEVSE, from the body its network task fetched last.
+ *
+ * Answers at once, the web server task never waits for the SmartEVSE. A stale body is still sent, with
+ * its Age, and the network task is asked to refresh it for the next request. Requests that find it stale
+ * share that refresh, so the SmartEVSE only ever sees the display's own poller.
+ */
+esp_err_t sendEvseSettings(httpd_req_t *req) {
+    if (settingsCache.getAge() >= settingsTtl) {
+        // The first unit feeds the cache.
+        evsePollers[0].requestSettings();
+    }
+
+    char condition[64];
+    const bool hasCondition =
+            httpd_req_get_hdr_value_str(req, "If-None-Match", condition, sizeof(condition)) == ESP_OK;
+    // The body stays pinned while it is sent, without holding up the network task.
+    const bool cached = settingsCache.read([&](const char *body, const size_t length, const char *etag,
+                                               const uint32_t age) {
+        char ageStr[12];
+        snprintf(ageStr, sizeof(ageStr), "%u", static_cast<unsigned>(age / 1000));
+        char cacheControl[24];
+        snprintf(cacheControl, sizeof(cacheControl), "max-age=%u",
+                 static_cast<unsigned>(age < settingsTtl ? (settingsTtl - age) / 1000 : 0));
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_set_hdr(req, "ETag", etag);
+        httpd_resp_set_hdr(req, "Age", ageStr);
+        httpd_resp_set_hdr(req, "Cache-Control", cacheControl);
+        if (hasCondition && (strcmp(condition, "*") == 0 || strstr(condition, etag) != nullptr)) {
+            httpd_resp_set_status(req, "304 Not Modified");
+            httpd_resp_send(req, nullptr, 0);
+        } else {
+            httpd_resp_send(req, body, static_cast<ssize_t>(length));
         }
-        retryCount--;
-        delay(1000); // Wait between retries.
+    });
+    if (!cached) {
+        // Nothing fetched yet, the refresh is under way.
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, "SmartEVSE settings not fetched yet", HTTPD_RESP_USE_STRLEN);
     }
+    return ESP_OK;
+}
 
-    if (!hosts.empty()) {
-        cachedMdnsHosts = hosts;
+/**
+ * Describe a circuit breaker for /api/poll.
+ */
+void addBreakerStatus(JsonObject object, const BreakerStatus &status) {
+    static const char *const STATES[] = {"closed", "open", "half-open"};
+    object["state"] = STATES[status.state];
+    object["failures"] = status.failures;
+    object["retryInMs"] = status.retryInMs;
+}
+
+/**
+ * Describe the stages of the LCD pipeline for /api/poll.
+ */
+void addPipelineStats(JsonObject object, const PipelineStats &stats) {
+    static const char *const NAMES[] = {"fetch", "decode", "render"};
+    const PipelineStageStats *const stages[] = {&stats.fetch, &stats.decode, &stats.render};
+    for (size_t i = 0; i < 3; i++) {
+        JsonObject stage = object[NAMES[i]].to<JsonObject>();
+        stage["depth"] = stages[i]->depth;
+        stage["total"] = stages[i]->total;
+        stage["dropped"] = stages[i]->dropped;
+        stage["perSecond"] = stages[i]->perSecond;
     }
+}
+
+/**
+ * Describe a latency histogram for /api/latency, in µs.
+ */
+void addLatencySummary(JsonObject object, const LatencySummary &summary) {
+    object["count"] = summary.count;
+    object["p50"] = summary.percentile(0.5f);
+    object["p95"] = summary.percentile(0.95f);
+    object["max"] = summary.max;
+    JsonArray buckets = object["buckets"].to<JsonArray>();
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        auto bucket = buckets.add<JsonObject>();
+        // The last bucket has no upper bound.
+        if (i < LATENCY_HISTOGRAM_BUCKETS - 1) {
+            bucket["le"] = LatencyHistogram::BOUNDS[i];
+        }
+        bucket["count"] = summary.buckets[i];
+    }
+}
 
-    return !hosts.empty() ? hosts : cachedMdnsHosts;
+/**
+ * Send a chunk of the response to request, a Metrics::WriteFunction.
+ */
+void sendResponseChunk(void *request, const char *text, const size_t length) {
+    httpd_resp_send_chunk(static_cast<httpd_req_t *>(request), text, static_cast<ssize_t>(length));
 }
 
 esp_err_t httpGetHandler(httpd_req_t *req) {
     Serial.printf("==== Process GET request uri: %s\n", req->uri);
 
     if (strcmp(req->uri, "/api/wifi") == 0) {
-        auto networks = scanWifiNetworks();
+        // Answer from the last completed scan, and have loop() scan again when it is stale.
         JsonDocument doc;
-        JsonArray array = doc.to<JsonArray>();
+        {
+            std::lock_guard<std::mutex> lock(wifiScanMutex);
+            const unsigned long currentTime = millis();
+            if (lastScanTime == 0 || currentTime - lastScanTime >= SCAN_INTERVAL) {
+                wifiScanRequested = true;
+            }
+            // Milliseconds since boot, and since the scan, 0 and -1 before the first scan.
+            doc["scannedAt"] = lastScanTime;
+            doc["age"] = lastScanTime != 0 ? static_cast<long>(currentTime - lastScanTime) : -1L;
+            JsonArray array = doc["networks"].to<JsonArray>();
+
+            for (auto &i: cachedNetworks) {
+                auto network = array.add<JsonObject>();
+                network["ssid"] = i.ssid;
+                network["rssi"] = i.rssi;
+                network["open"] = i.isOpen;
+            }
+        }
+        doc["scanning"] = wifiScanRequested || wifiScanRunning;
 
-        for (auto &i: networks) {
-            auto network = array.add<JsonObject>();
-            network["ssid"] = i.ssid;
-            network["rssi"] = i.rssi;
-            network["open"] = i.isOpen;
+        String json;
+        serializeJson(doc, json);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_send(req, json.c_str(), static_cast<ssize_t>(json.length()));
+        return ESP_OK;
+    }
+
+    if (strcmp(req->uri, "/api/events") == 0) {
+        // The socket stays open after the handler returns, flushEvents() writes the events to it.
+        if (!eventStream.subscribe(httpd_req_to_sockfd(req))) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            httpd_resp_set_type(req, "text/plain");
+            httpd_resp_send(req, "Too many clients", HTTPD_RESP_USE_STRLEN);
         }
+        return ESP_OK;
+    }
+
+    if (strncmp(req->uri, "/api/lcd", 8) == 0 && (req->uri[8] == '\0' || req->uri[8] == '?')) {
+        return sendLcdFrame(req);
+    }
+
+    if (strcmp(req->uri, "/api/evse/settings") == 0) {
+        return sendEvseSettings(req);
+    }
+
+    if (strcmp(req->uri, "/api/poll") == 0) {
+        // How fast each unit is polled, to tune the poll_rates preference.
+        static const char *const PACES[] = {"fast", "normal", "idle"};
+        JsonDocument doc;
+        JsonArray array = doc.to<JsonArray>();
+        for (size_t i = 0; i < evseTargetCount; i++) {
+            const PollStats stats = evsePollers[i].getPollStats();
+            auto unit = array.add<JsonObject>();
+            unit["host"] = evseTargets[i].host;
+            unit["pace"] = PACES[stats.pace];
+            unit["fps"] = stats.framesPerSecond;
+            unit["lcdRequestsPerSecond"] = stats.lcdRequestsPerSecond;
+            unit["settingsRequestsPerSecond"] = stats.settingsRequestsPerSecond;
+            addBreakerStatus(unit["lcdBreaker"].to<JsonObject>(), evsePollers[i].getLcdBreakerStatus());
+            addBreakerStatus(unit["settingsBreaker"].to<JsonObject>(), evsePollers[i].getSettingsBreakerStatus());
+            addPipelineStats(unit["pipeline"].to<JsonObject>(), evsePollers[i].getPipelineStats());
+            // How well the kept-alive connection is reused.
+            const hal::HttpStats http = evseHttpClients[i].getStats();
+            unit["connectionsOpened"] = http.connectionsOpened;
+            unit["requestsServed"] = http.requestsServed;
+        }
+
+        String json;
+        serializeJson(doc, json);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_send(req, json.c_str(), static_cast<ssize_t>(json.length()));
+        return ESP_OK;
+    }
+
+    if (strcmp(req->uri, "/api/latency") == 0) {
+        // How long the touch feedback takes.
+        JsonDocument doc;
+        addLatencySummary(doc["touchToBeep"].to<JsonObject>(), metrics.histogram(STAGE_TOUCH_TO_BEEP).getSummary());
+        addLatencySummary(doc["touchToPixels"].to<JsonObject>(),
+                          metrics.histogram(STAGE_TOUCH_TO_PIXELS).getSummary());
 
         String json;
         serializeJson(doc, json);
@@ -237,7 +669,22 @@ esp_err_t httpGetHandler(httpd_req_t *req) {
         return ESP_OK;
     }
 
+    if (strcmp(req->uri, "/api/metrics") == 0) {
+        // The Prometheus text format, see Metrics::writePrometheus().
+        uint32_t jsonArenaFallbacks = eventStream.getJsonArenaFallbacks();
+        for (const EvseClient &client: evseClients) {
+            jsonArenaFallbacks += client.getJsonArenaFallbacks();
+        }
+        const HeapStats heap = {ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap(),
+                                steadyStateAllocations.load(), jsonArenaFallbacks};
+        httpd_resp_set_type(req, "text/plain; version=0.0.4");
+        metrics.writePrometheus(heap, compositor.getStats(), sendResponseChunk, req);
+        httpd_resp_send_chunk(req, nullptr, 0);
+        return ESP_OK;
+    }
+
     if (strcmp(req->uri, "/api/mdns") == 0) {
+        // The hosts found so far, poll again while X-Discovery-Browsing is true to get the rest.
         auto hosts = discoverMDNS();
         JsonDocument doc;
         JsonArray array = doc.to<JsonArray>();
@@ -245,50 +692,66 @@ esp_err_t httpGetHandler(httpd_req_t *req) {
         for (auto &host: hosts) {
             auto network = array.add<JsonObject>();
             network["host"] = host.host;
+            network["ip"] = host.ip;
+            network["port"] = host.port;
         }
 
         String json;
         serializeJson(doc, json);
         httpd_resp_set_type(req, "application/json");
         httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_set_hdr(req, "X-Discovery-Browsing", mdnsBrowser.isBrowsing() ? "true" : "false");
         httpd_resp_send(req, json.c_str(), static_cast<ssize_t>(json.length()));
         return ESP_OK;
     }
 
-    size_t size = 0;
-    time_t mtime = 0;
-    auto uri = String(req->uri);
-    if (uri == "/") {
-        uri = "/index.html";
-    }
-    auto contentType = "text/html";
-    bool isCss = uri.endsWith(".css");
-    bool isJs = uri.endsWith(".js");
-
-    if (isCss) {
-        contentType = "text/css";
-    } else if (isJs) {
-        contentType = "application/javascript";
-    }
-
     // Do we need to reboot the device?
-    if (uri.indexOf("?reboot=true") > -1) {
+    if (strstr(req->uri, "?reboot=true") != nullptr) {
         reboot = true;
     }
 
     // Strip everything from the URL from "?"
-    if (uri.indexOf("?") > -1) {
-        uri = uri.substring(0, uri.indexOf("?"));
+    char path[64];
+    snprintf(path, sizeof(path), "%.*s", static_cast<int>(strcspn(req->uri, "?")), req->uri);
+    const packed_file *file = mg_unpack_file(strcmp(path, "/") == 0 ? "/index.html" : path);
+
+    // Send the gzipped copy to clients that accept it, pack.py only made one if it is smaller.
+    char acceptEncoding[64];
+    const bool gzipped = file != nullptr && file->gzip != nullptr &&
+                         httpd_req_get_hdr_value_str(req, "Accept-Encoding", acceptEncoding,
+                                                     sizeof(acceptEncoding)) == ESP_OK &&
+                         strstr(acceptEncoding, "gzip") != nullptr;
+    if (gzipped) {
+        file = file->gzip;
     }
-
-    auto path = String("/data" + uri).c_str();
-    auto data = mg_unpack(path, &size, &mtime);
-    if (data != nullptr) {
-        httpd_resp_set_type(req, contentType);
+    if (file != nullptr) {
+        httpd_resp_set_type(req, file->mime);
         char timeStr[32];
-        strftime(timeStr, sizeof(timeStr), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&mtime));
+        strftime(timeStr, sizeof(timeStr), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&file->mtime));
         httpd_resp_set_hdr(req, "Last-Modified", timeStr);
-        httpd_resp_send(req, data, static_cast<ssize_t>(size));
+        httpd_resp_set_hdr(req, "ETag", file->etag);
+        // Cached, but revalidated on every use. Unchanged files cost a 304 without a body.
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+        // If-None-Match wins over If-Modified-Since.
+        char condition[128];
+        bool notModified = false;
+        if (httpd_req_get_hdr_value_str(req, "If-None-Match", condition, sizeof(condition)) == ESP_OK) {
+            notModified = strcmp(condition, "*") == 0 || strstr(condition, file->etag) != nullptr;
+        } else if (httpd_req_get_hdr_value_str(req, "If-Modified-Since", condition, sizeof(condition)) == ESP_OK) {
+            notModified = strcmp(condition, timeStr) == 0;
+        }
+        if (notModified) {
+            httpd_resp_set_status(req, "304 Not Modified");
+            httpd_resp_send(req, nullptr, 0);
+            return ESP_OK;
+        }
+
+        if (gzipped) {
+            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        }
+        httpd_resp_send(req, reinterpret_cast<const char *>(file->data), static_cast<ssize_t>(file->size - 1));
         return ESP_OK;
     }
 
@@ -329,8 +792,8 @@ esp_err_t httpPostHandler(httpd_req_t *req) {
             return ESP_FAIL;
         }
 
-        preferences.putString(PREFERENCES_KEY_WIFI_SSID.c_str(), ssid);
-        preferences.putString(PREFERENCES_KEY_WIFI_PASSWORD.c_str(), password);
+        storage.putString(PREFERENCES_KEY_WIFI_SSID.c_str(), ssid.c_str());
+        storage.putString(PREFERENCES_KEY_WIFI_PASSWORD.c_str(), password.c_str());
 
         Serial.printf("==== httpPostHandler(): Save ssid to preferences: %s\n", ssid.c_str());
         Serial.printf("==== httpPostHandler(): Save password to preferences\n");
@@ -347,13 +810,79 @@ esp_err_t httpPostHandler(httpd_req_t *req) {
     return ESP_FAIL;
 }
 
+/**
+ * A web client socket is closed, stop sending it events and frames.
+ */
+void onWebClientClose(httpd_handle_t, const int fd) {
+    eventStream.unsubscribe(fd);
+    lcdStream.cancel(fd);
+    close(fd);
+}
+
+/**
+ * Send the pending events and LCD frames, queued on the web server task by the UI.
+ */
+void flushEvents(void *) {
+    eventStream.flush();
+    lcdStream.flush();
+}
+
+/**
+ * Publish the SmartEVSE state to the web clients following /api/events, if it changed.
+ */
+void publishEvents(const EvseSnapshot &snapshot) {
+    if (eventStream.publish(snapshot, wifiConnected)) {
+        webFlushPending = true;
+    }
+}
+
+/**
+ * Have flushEvents() time out the parked /api/lcd requests, also while no frames arrive because the
+ * LCD breaker is open or no unit is selected. Called on every loop() iteration.
+ */
+void checkLongPolls() {
+    static unsigned long lastCheck = 0;
+    if (lcdStream.getWaiterCount() > 0 && millis() - lastCheck >= LCD_LONG_POLL_CHECK_INTERVAL) {
+        lastCheck = millis();
+        webFlushPending = true;
+    }
+}
+
+/**
+ * Ping the web clients following /api/events every EVENT_PING_INTERVAL, also while nothing is polled,
+ * so closed sockets are noticed and freed. Called on every loop() iteration.
+ */
+void pingEventClients() {
+    static unsigned long lastPing = 0;
+    if (millis() - lastPing >= EVENT_PING_INTERVAL) {
+        lastPing = millis();
+        eventStream.ping();
+        webFlushPending = true;
+    }
+}
+
+/**
+ * Have the web server send what was published. Queuing the work sends a message to the web server task,
+ * which allocates, so it happens once per loop() iteration after the rendering.
+ */
+void wakeWebServer() {
+    if (webFlushPending && webServer != nullptr) {
+        httpd_queue_work(webServer, flushEvents, nullptr);
+    }
+    webFlushPending = false;
+}
+
 void startWebserver() {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     httpd_handle_t server = nullptr;
     // Add wildcard support.
     // https://community.platformio.org/t/esp-http-server-h-has-no-wildcard/11732
     config.uri_match_fn = httpd_uri_match_wildcard;
+    // Event stream clients keep their socket, close the least recently used one when all are taken.
+    config.lru_purge_enable = true;
+    config.close_fn = onWebClientClose;
     httpd_start(&server, &config);
+    webServer = server;
 
     httpd_uri_t get_uri = {
         .uri = "*",
@@ -448,68 +977,6 @@ void startApMode() {
     drawQRCode(url.c_str(), 4, qrY, qrX);
 }
 
-void displayMonochromeBitmap(WiFiClient *stream, const int width, const int height, const int x, const int y,
-                             const int foregroundColor = TFT_WHITE, const int backgroundColor = TFT_BLACK) {
-    // Skip the bitmap header.
-    // The BMP header is off, should be 62, figure out what's going on.
-    // Uint8_t header[62];
-    uint8_t header[67];
-    stream->read(header, sizeof(header));
-
-    // Calculate bytes per row (1 bit per pixel, 8 pixels per byte)
-    const int bytesPerRow = width / 8; // Ceiling of width/8
-    const int paddedBytesPerRow = bytesPerRow; // No padding, as per original code
-
-    // Allocate the buffer for all the row data
-    auto *rowData = new uint8_t[paddedBytesPerRow * height];
-
-    // Read all pixel data into the buffer
-    stream->read(rowData, paddedBytesPerRow * height);
-
-    // Begin writing to the display with doubled dimensions
-    M5.Display.startWrite();
-    M5.Display.setAddrWindow(x, y, width * 2, height * 2);
-
-    uint16_t buffer[256]; // Buffer for one doubled row (max 128 * 2 = 256 pixels)
-
-    // Function to reverse bit order (for mirroring fix)
-    auto reverseBits = [](uint8_t b) -> uint8_t {
-        b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-        b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-        b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-        return b;
-    };
-
-    // Process rows from bottom to top
-    for (int row = height - 1; row >= 0; --row) {
-        int bufferIndex = 0;
-
-        // Get the current row's data
-        const uint8_t *currentRow = rowData + row * paddedBytesPerRow;
-
-        // Process each byte in the row
-        for (int col = 0; col < bytesPerRow; ++col) {
-            uint8_t byte = reverseBits(currentRow[col]); // Reverse bits to fix mirroring
-
-            // Process each bit in the byte (left to right)
-            for (int bit = 0; bit < 8 && col * 8 + bit < width; ++bit) {
-                // Duplicate each pixel horizontally (2 pixels per original pixel)
-                uint16_t pixel = (byte & (1 << bit)) ? foregroundColor : backgroundColor;
-                buffer[bufferIndex++] = pixel;
-                buffer[bufferIndex++] = pixel; // Double horizontally
-            }
-        }
-
-        // Push the row buffer to the display twice for vertical doubling
-        M5.Display.pushPixels(buffer, width * 2);
-        M5.Display.pushPixels(buffer, width * 2); // Repeat row for 2x vertical scale
-    }
-
-    // Clean up
-    delete[] rowData;
-    M5.Display.endWrite();
-}
-
 /**
  * Initialize all button.
  */
@@ -525,29 +992,75 @@ void initButtons() {
                             "Select EVSE", 3);
 }
 
+/**
+ * Allocate the sprites of the widgets. The buttons stay hidden until the SmartEVSE state is known.
+ */
+void initWidgets() {
+    SpriteWidget *const widgets[] = {
+        &wifiWidget, &evseWidget, &modeWidget, &errorWidget, &fleetWidget, &solarWidget, &smartWidget, &configWidget
+    };
+    for (SpriteWidget *widget: widgets) {
+        if (!widget->begin()) {
+            Serial.printf("==== initWidgets() no memory for a %dx%d sprite\n", widget->getWidth(),
+                          widget->getHeight());
+        }
+        compositor.add(*widget);
+    }
+    solarWidget.setVisible(false);
+    smartWidget.setVisible(false);
+    configWidget.setVisible(false);
+}
+
+uint32_t buttonWidgetValue(const bool active, const bool pressed) {
+    return (active ? BUTTON_WIDGET_ACTIVE : 0) | (pressed ? BUTTON_WIDGET_PRESSED : 0);
+}
+
+// The draw...Button() functions bind the state to the button widgets, composeWidgets() draws what changed.
+
 void drawSolarButton(const bool pressed = false) {
-    solarButton.setFillColor(0xF680);
-    solarButton.setOutlineColor(mode == "Solar" ? ACTIVE_BORDER_COLOR : BACKGROUND_COLOR);
-    solarButton.drawButton(pressed);
+    solarWidget.bind(buttonWidgetValue(mode == EVSE_MODE_SOLAR, pressed));
 }
 
 void drawSmartButton(const bool pressed = false) {
-    smartButton.setFillColor(0x07E0);
-    smartButton.setOutlineColor(mode == "Smart" ? ACTIVE_BORDER_COLOR : BACKGROUND_COLOR);
-    smartButton.drawButton(pressed);
+    smartWidget.bind(buttonWidgetValue(mode == EVSE_MODE_SMART, pressed));
 }
 
 void drawConfigButton(const bool pressed = false) {
-    configButton.setFillColor(TFT_RED);
-    configButton.setOutlineColor(ACTIVE_BORDER_COLOR);
-    configButton.drawButton(pressed);
+    configWidget.bind(buttonWidgetValue(true, pressed));
 }
 
 /**
- * Clear the complete button area.
+ * Clear the complete button area and hide the buttons.
  */
 void clearButtonsArea() {
     M5.Display.fillRect(0, BUTTON_Y, M5.Display.width(), BUTTON_HEIGHT, BACKGROUND_COLOR);
+    solarWidget.setVisible(false);
+    smartWidget.setVisible(false);
+    configWidget.setVisible(false);
+}
+
+/**
+ * Show the Solar and Smart buttons while the SmartEVSE is connected, the Select EVSE button otherwise.
+ */
+void showButtons(const bool connected) {
+    clearButtonsArea();
+    solarWidget.setVisible(connected);
+    smartWidget.setVisible(connected);
+    configWidget.setVisible(!connected);
+    if (connected) {
+        drawSolarButton(false);
+        drawSmartButton(false);
+    } else {
+        drawConfigButton(false);
+    }
+}
+
+/**
+ * Draw and push the widgets that changed.
+ */
+void composeWidgets() {
+    StageTimer timer(&metrics, STAGE_DRAW_STATUS);
+    compositor.compose();
 }
 
 /**
@@ -613,6 +1126,97 @@ void handleTouchInput(const bool touchDetected) {
     }
 }
 
+/**
+ * Tell loop() what was touched.
+ */
+void postTouchEvent(const TouchAction action, const uint32_t detectedAt) {
+    const TouchEvent event = {action, detectedAt};
+    if (xQueueSend(touchEvents, &event, 0) != pdTRUE) {
+        Serial.printf("==== postTouchEvent() queue full, dropped: %d\n", action);
+    }
+}
+
+/**
+ * The touch task. Samples the touch screen, beeps and draws the pressed button right away,
+ * and leaves the rest to loop().
+ */
+void touchTask(void *) {
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(TOUCH_SAMPLE_INTERVAL));
+
+        bool solarPressed, smartPressed, configPressed, solarReleased, smartReleased, configReleased;
+        int swipe = 0;
+        uint32_t detectedAt;
+        {
+            std::lock_guard<std::mutex> lock(touchMutex);
+            M5.update();
+            detectedAt = micros();
+            if (!wifiConnected) {
+                continue;
+            }
+            handleTouchInput(M5.Touch.getCount() > 0);
+            solarPressed = solarButton.justPressed();
+            smartPressed = smartButton.justPressed();
+            configPressed = configButton.justPressed();
+            solarReleased = solarButton.justReleased();
+            smartReleased = smartButton.justReleased();
+            configReleased = configButton.justReleased();
+
+            // Swipe over the LCD to show the next or previous unit.
+            const auto touchPoint = M5.Touch.getDetail(0);
+            if (touchPoint.wasFlicked() && touchPoint.base_y < BUTTON_Y) {
+                swipe = touchPoint.distanceX() < 0 ? 1 : -1;
+            }
+        }
+
+        const bool pressed = solarPressed || smartPressed || configPressed;
+        if (pressed) {
+            playBeep(smartPressed ? 2000 : 1000);
+            metrics.record(STAGE_TOUCH_TO_BEEP, micros() - detectedAt);
+        }
+        if (pressed || solarReleased || smartReleased || configReleased) {
+            std::lock_guard<std::mutex> lock(displayMutex);
+            if (solarPressed) {
+                Serial.printf("==== touchTask() solarButton.justPressed()\n");
+                mode = EVSE_MODE_SOLAR;
+                drawSolarButton(true);
+            }
+            if (smartPressed) {
+                Serial.printf("==== touchTask() smartButton.justPressed()\n");
+                mode = EVSE_MODE_SMART;
+                drawSmartButton(true);
+            }
+            if (solarReleased || smartReleased) {
+                // Update the active state of both buttons.
+                drawSolarButton(false);
+                drawSmartButton(false);
+            }
+            if (configPressed) {
+                Serial.printf("==== touchTask() configButton.justPressed()\n");
+                drawConfigButton(true);
+            }
+            if (configReleased) {
+                drawConfigButton(false);
+            }
+            composeWidgets();
+            M5.Display.waitDisplay();
+            if (pressed) {
+                metrics.record(STAGE_TOUCH_TO_PIXELS, micros() - detectedAt);
+            }
+        }
+
+        if (solarReleased || smartReleased) {
+            postTouchEvent(solarReleased ? TOUCH_SOLAR : TOUCH_SMART, detectedAt);
+        }
+        if (configReleased) {
+            postTouchEvent(TOUCH_CONFIG, detectedAt);
+        }
+        if (swipe != 0) {
+            postTouchEvent(swipe > 0 ? TOUCH_SWIPE_NEXT : TOUCH_SWIPE_PREVIOUS, detectedAt);
+        }
+    }
+}
+
 bool connectToWiFi(const String &ssid, const String &password) {
     Serial.printf("==== connectToWiFi() ssid: %s\n", ssid.c_str());
 
@@ -626,139 +1230,161 @@ bool connectToWiFi(const String &ssid, const String &password) {
     return WiFiClass::status() == WL_CONNECTED;
 }
 
-// ---- Fetch Data from Smart EVSE ----
-void showTimeoutMessage();
-
 /**
- * Fetches settings and status data from the SmartEVSE server.
+ * The network task of one unit. Polls the SmartEVSE and publishes the results to the UI,
+ * so the UI never blocks on a socket.
  *
- * This method communicates with the SmartEVSE device through an HTTP
- * request to retrieve current settings and operational data. If the
- * device is unreachable or the network is not connected, it updates
- * the state to indicate disconnection.
+ * @param parameter The unit.
  */
-void fetchSmartEVSEData() {
-    const String ERROR_NO_HOST = "No SmartEVSE host";
-    const String ERROR_JSON_FAILED = "SmartEVSE Failed";
-    const String ERROR_TIMEOUT = "SmartEVSE Timeout";
-
-    Serial.printf("==== fetchSmartEVSEData() for host: \"%s\"\n", smartEvseHost.c_str());
-    if (!wifiConnected) {
-        evseConnected = false;
-        return;
-    }
-    if (smartEvseHost == nullptr || smartEvseHost.isEmpty()) {
-        Serial.printf("==== fetchSmartEVSEData() smartEvseHost is empty\n");
-        evseConnected = false;
-        error = ERROR_NO_HOST;
-        return;
+void networkTask(void *parameter) {
+    const size_t unit = reinterpret_cast<size_t>(parameter);
+    for (;;) {
+        if (evseFleet.isActive(unit)) {
+            evsePollers[unit].poll();
+            if (evsePollers[unit].lcdWaiting()) {
+                xTaskNotifyGive(decodeTaskHandle);
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
     }
+}
 
-    HTTPClient http;
-    const String url = "http://" + smartEvseHost + ".local/settings";
-    http.begin(url);
-    http.setTimeout(1500);
+/**
+ * The decode task. Turns the LCD bitmaps the network tasks fetched into frames for loop().
+ */
+void decodeTask(void *) {
+    for (;;) {
+        // The timeout picks up an LCD fetched while the units were decoded.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DECODE_TASK_TIMEOUT));
+        // Units without a network task have nothing to decode.
+        for (size_t i = 0; i < EVSE_MAX_UNITS; i++) {
+            evsePollers[i].decode();
+        }
+    }
+}
 
-    const int httpResponseCode = http.GET();
-    Serial.printf("==== fetchSmartEVSEData() httpResponseCode: %d\n", httpResponseCode);
+/**
+ * Start the network tasks of the units that don't have one yet, and the decode task they hand the LCD to.
+ */
+void startNetworkTasks() {
+    if (decodeTaskHandle == nullptr) {
+        xTaskCreatePinnedToCore(decodeTask, "decode", DECODE_TASK_STACK_SIZE, nullptr, 1, &decodeTaskHandle,
+                                NETWORK_TASK_CORE);
+    }
+    for (size_t i = 0; i < evseFleet.getCount(); i++) {
+        if (networkTaskHandles[i] == nullptr) {
+            char name[12];
+            snprintf(name, sizeof(name), "network%u", static_cast<unsigned>(i));
+            xTaskCreatePinnedToCore(networkTask, name, NETWORK_TASK_STACK_SIZE, reinterpret_cast<void *>(i), 1,
+                                    &networkTaskHandles[i], NETWORK_TASK_CORE);
+        }
+    }
+}
 
-    if (httpResponseCode >= 200 && httpResponseCode < 300) {
-        String payload = http.getString();
-        evseConnected = true;
+/**
+ * Point the network tasks at the selected SmartEVSE units, by their cached addresses.
+ */
+void targetSmartEvse() {
+    evseFleet.setTargets(evseTargets, evseTargetCount);
+}
 
-        // JSON parsing.
-        JsonDocument doc;
-        const DeserializationError jsonError = deserializeJson(doc, payload);
-
-        if (!jsonError) {
-            // Extract values from JSON and update the global variables.
-            chargeCurrent = doc["settings"]["charge_current"];
-            gridCurrent = doc["phase_currents"]["TOTAL"];
-            const String evseStateText = doc["evse"]["state"];
-            const int modeId = doc["mode_id"];
-
-            evseState = evseStateText;
-            switch (modeId) {
-                case 0:
-                    mode = "Off";
-                    break;
-                case 1:
-                    mode = "Normal";
-                    break;
-                case 2:
-                    mode = "Solar";
-                    break;
-                case 3:
-                    mode = "Smart";
-                    break;
-                case 4:
-                    mode = "Pause";
-                    break;
-                default:
-                    mode = "Unknown";
-                    break;
-            }
+/**
+ * Save the selected SmartEVSE units with their addresses.
+ */
+void saveSmartEvseTargets() {
+    char list[EVSE_TARGET_LIST_LEN];
+    formatTargetList(evseTargets, evseTargetCount, list, sizeof(list));
+    storage.putString(PREFERENCES_KEY_EVSE_HOSTS.c_str(), list);
+}
 
-            // Clear any SmartEVSE-related error.
-            if (error == ERROR_NO_HOST || error == ERROR_JSON_FAILED || error == ERROR_TIMEOUT) {
-                error = "";
-            }
-        } else {
-            evseConnected = false;
-            error = ERROR_JSON_FAILED;
-            Serial.printf("==== fetchSmartEVSEData() parsing JSON failed\n");
+/**
+ * The discovery task. Runs the mDNS browses requested by the UI and the web server.
+ */
+void discoveryTask(void *) {
+    for (;;) {
+        if (!mdnsBrowser.step()) {
+            vTaskDelay(pdMS_TO_TICKS(50));
         }
-    } else {
-        evseConnected = false;
-        error = ERROR_TIMEOUT;
     }
-    http.end();
 }
 
+/**
+ * Bind the state to the status bar widgets, composeWidgets() pushes the ones that changed.
+ */
 void drawStatus() {
-    // Reset status and text area.
-    M5.Display.fillRect(0, 204, M5.Display.width(), 20, TFT_BLACK);
-    // Reset error area.
-    M5.Display.fillRect(0, 224, M5.Display.width(), 20, TFT_BLACK);
-
-    M5.Display.setTextSize(2);
-
     // The WiFi Status Indicator.
-    M5.Display.setTextColor(TFT_LIGHTGRAY);
-    M5.Display.setCursor(16, 204);
-    M5.Display.print("WIFI");
-    M5.Display.fillCircle(76, 210, 5, wifiConnected ? TFT_GREEN : TFT_RED);
+    wifiWidget.bind(wifiConnected);
 
     // The EVSE Status Indicator.
-    M5.Display.setTextColor(TFT_LIGHTGRAY);
-    M5.Display.setCursor(100, 204);
-    M5.Display.print("EVSE ");
-    M5.Display.fillCircle(160, 210, 5, evseConnected ? TFT_GREEN : TFT_RED);
+    // Orange while the breaker waits before the next attempt, yellow while it tries again.
+    uint16_t evseColor = evseConnected ? TFT_GREEN : TFT_RED;
+    if (evseBreaker == BREAKER_OPEN) {
+        evseColor = TFT_ORANGE;
+    } else if (evseBreaker == BREAKER_HALF_OPEN) {
+        evseColor = TFT_YELLOW;
+    }
+    evseWidget.bind(evseColor);
 
     // The Mode.
-    M5.Display.setTextColor(TFT_LIGHTGRAY);
-    M5.Display.setCursor(184, 204);
-    M5.Display.print("Mode:" + (evseConnected ? mode : "-"));
+    modeWidget.bind(evseConnected ? static_cast<uint32_t>(mode) : MODE_WIDGET_NONE);
 
     // Show Error.
-    M5.Display.setTextColor(error == "" || error == "None" ? TFT_DARKGRAY : TFT_RED);
-    M5.Display.setCursor(16, 224);
-    M5.Display.print("Error: " + error);
+    errorWidget.bind(error);
+}
 
-    // Rest text color.
-    M5.Display.setTextColor(TEXT_COLOR);
+/**
+ * With more than one unit, bind which one is on screen and the totals over all units to the fleet widget,
+ * between the buttons and the status bar. composeWidgets() draws it when the line changed.
+ */
+void drawFleetStatus() {
+    const FleetTotals totals = evseFleet.totals();
+    char line[sizeof(fleetStatusLine)] = "";
+    if (totals.units >= 2) {
+        formatFleetTotals(totals, evseFleet.getCurrent(), line, sizeof(line));
+    }
+    const bool complete = totals.connected == totals.units;
+    if (strcmp(line, fleetStatusLine) != 0 || complete != fleetStatusComplete) {
+        copyString(fleetStatusLine, line);
+        fleetStatusComplete = complete;
+        fleetStatusVersion++;
+    }
+    fleetWidget.bind(fleetStatusVersion);
 }
 
+// The "No Conn" image, decoded once to RGB565 by initPlaceholder() so it is shown with a single push.
+M5Canvas placeholderCanvas(&M5.Display);
+bool placeholderDecoded = false;
+
+/**
+ * Decode the placeholder image into its sprite. Without memory for it, the PNG is decoded each time it is shown.
+ */
+void initPlaceholder() {
+    const packed_file *placeholder = mg_unpack_file("/lcd-placeholder.png");
+    placeholderCanvas.setColorDepth(16);
+    placeholderCanvas.setPsram(true);
+    if (placeholder == nullptr || placeholderCanvas.createSprite(2 * LCD_WIDTH, 2 * LCD_HEIGHT) == nullptr) {
+        Serial.printf("==== initPlaceholder() no image or no memory for its sprite\n");
+        return;
+    }
+    placeholderDecoded = placeholderCanvas.drawPng(placeholder->data, placeholder->size - 1, 0, 0);
+    if (!placeholderDecoded) {
+        placeholderCanvas.deleteSprite();
+    }
+}
 
 void drawSmartEvseNoConnection() {
     constexpr int imageX = 32;
+    if (placeholderDecoded) {
+        placeholderCanvas.pushSprite(imageX, 0);
+        return;
+    }
+
     // Display placeholder image.
-    size_t size = 0;
-    time_t mtime = 0;
-    const auto path = String("/data/lcd-placeholder.png").c_str();
-    const char *data = mg_unpack(path, &size, &mtime);
+    static const packed_file *placeholder = mg_unpack_file("/lcd-placeholder.png");
 
-    if (data == nullptr) {
+    if (placeholder == nullptr) {
         // This cannot happen, show error.
         M5.Display.setTextColor(TFT_RED);
         M5.Display.setCursor(imageX, 10);
@@ -767,160 +1393,146 @@ void drawSmartEvseNoConnection() {
     }
 
     // Display the "No Conn" image.
-    if (!M5.Display.LGFXBase::drawPng(reinterpret_cast<const uint8_t *>(data), size, imageX, 0)) {
+    if (!M5.Display.LGFXBase::drawPng(placeholder->data, placeholder->size - 1, imageX, 0)) {
         M5.Display.setTextColor(TFT_RED);
         M5.Display.setCursor(imageX, 10);
         M5.Display.println("Failed to decode PNG");
     }
 }
 
+// The placeholder is on screen, it is not drawn again until a frame replaced it.
+bool placeholderShown = false;
+
 /**
- * Draw the SmartEVSE LCD screen.
- * If not connected to a network, do nothing.
+ * The LCD area was drawn over, draw the next frame or placeholder in full.
  */
-void drawSmartEvseDisplay() {
-    if (!wifiConnected) {
-        return;
-    }
+void invalidateLcdArea() {
+    lcdMirror.invalidate();
+    placeholderShown = false;
+}
 
-    if (smartEvseHost == nullptr || smartEvseHost.isEmpty()) {
-        drawSmartEvseNoConnection();
+/**
+ * Draw the SmartEVSE LCD screen.
+ * If the SmartEVSE could not be reached, show the placeholder image.
+ */
+void drawSmartEvseDisplay(const LcdFrame &frame) {
+    if (!frame.valid) {
+        // No connection.
+        if (!placeholderShown) {
+            drawSmartEvseNoConnection();
+            placeholderShown = true;
+        }
+        lcdMirror.invalidate();
         return;
     }
-
-    if (smartEvseHttpClient == nullptr) {
-        const String url = "http://" + smartEvseHost + ".local/lcd";
-        smartEvseHttpClient = new HTTPClient();
-        smartEvseHttpClient->begin(url);
-        smartEvseHttpClient->setTimeout(750);
-        smartEvseHttpClient->addHeader("User-Agent", "SmartEVSE-display");
-        smartEvseHttpClient->addHeader("Connection", "keep-alive");
-        smartEvseHttpClient->addHeader("Accept", "image/bmp");
+    placeholderShown = false;
+    {
+        StageTimer timer(&metrics, STAGE_LCD_BLIT);
+        lcdMirror.draw(frame);
     }
-
-    const int httpResponseCode = smartEvseHttpClient->GET();
-    Serial.printf("==== drawSmartEVSEDisplay() httpResponseCode: %d\n", httpResponseCode);
-
-    if (httpResponseCode >= 200 && httpResponseCode < 300) {
-        // The call was successful.
-        WiFiClient *stream = smartEvseHttpClient->getStreamPtr();
-        displayMonochromeBitmap(stream, 128, 64, 32, 0);
-        smartEvseHttpClient->end();
-        return;
-    }
-
-    // Force it to create a new http client the next time.
-    smartEvseHttpClient->end();
-    delete smartEvseHttpClient;
-    smartEvseHttpClient = nullptr;
-
-    // No connection.
-    drawSmartEvseNoConnection();
 }
 
 /**
- * Send Mode Change.
- *
- * @param newMode 2 = Solar, 3 = Smart
+ * Hand a frame of the unit on screen to the web clients following /api/lcd.
  */
-void sendModeChange(const String &newMode) {
-    const String ERROR_MODE_FAILED = "Mode failed";
+void publishFrame(const LcdFrame &frame) {
+    // Also after an unchanged frame, so long-polls that waited too long are answered.
+    lcdStream.publish(frame);
+    webFlushPending = true;
+}
 
-    if (!wifiConnected) {
-        return;
+/**
+ * Apply the state published by the network task and update the status bar and buttons.
+ */
+void applyEvseSnapshot(const EvseSnapshot &snapshot) {
+    // The error of the last applied snapshot, so local errors are only replaced when the SmartEVSE error changes.
+    static EvseError appliedSnapshotError = EVSE_ERROR_NONE;
+
+    const bool previousEvseConnected = evseConnected;
+    const EvseMode previousMode = mode;
+
+    evseConnected = snapshot.connected;
+    evseBreaker = snapshot.breaker;
+    mode = snapshot.mode;
+    evseState = snapshot.evseState;
+    chargeCurrent = snapshot.chargeCurrent;
+    gridCurrent = snapshot.gridCurrent;
+    if (appliedSnapshotError != snapshot.error) {
+        appliedSnapshotError = snapshot.error;
+        error = snapshot.error;
     }
+    drawStatus();
 
-    HTTPClient http;
-    // String url = "http://" + evse_ip + "/settings?mode=" + newMode + "&starttime=0&override_current=0&repeat=0";
-    String url = "http://" + smartEvseHost + ".local/settings?mode=" + newMode +
-                 "&override_current=0&starttime=2025-05-15T00:27&stoptime=2025-05-15T00:27&repeat=0";
-
-    http.begin(url);
-    // http.addHeader("Content-Type", "application/json");
-    http.addHeader("Content-Length", "0");
+    // If the status of the SmartEVSE is changed, update the buttons accordingly.
+    if (evseConnected != previousEvseConnected) {
+        showButtons(evseConnected);
+    }
 
-    // String jsonPayload = (newMode == "2") ?
-    //     "{\"starttime\":0,\"mode\":\"2\"}" :
-    //     "{\"starttime\":0,\"mode\":\"3\",\"override_current\":0}";
-    String jsonPayload = "";
-    const int httpResponseCode = http.POST(jsonPayload);
+    // If the mode changed, update the outline of the border,
+    if (mode != previousMode) {
+        drawSolarButton();
+        drawSmartButton();
+    }
+}
 
-    if (httpResponseCode >= 200 && httpResponseCode < 300) {
-        const String payload = http.getString();
-        // JSON parsing
-        JsonDocument doc;
-        const DeserializationError jsonError = deserializeJson(doc, payload);
-        if (!jsonError) {
-            // Clear all errors related to mode.
-            if (error == ERROR_MODE_FAILED) {
-                error = "";
-            }
+/**
+ * Show the unit that was swiped to: its last frame and state.
+ */
+void showCurrentUnit() {
+    Serial.printf("==== showCurrentUnit() unit: %u\n", static_cast<unsigned>(evseFleet.getCurrent()));
+    EvsePoller &poller = evseFleet.currentPoller();
+    invalidateLcdArea();
+    poller.consumeFrame();
+    drawSmartEvseDisplay(poller.frame());
+    publishFrame(poller.frame());
+    applyEvseSnapshot(poller.snapshot());
+    publishEvents(poller.snapshot());
+    drawFleetStatus();
+    composeWidgets();
+}
 
-            String modeId = doc["mode"];
-            if (modeId == "2") {
-                mode = "Solar";
-            } else if (modeId == "3") {
-                mode = "Smart";
-            } else {
-                Serial.printf("==== sendModeChange() failed, received unexpected modeId: %s\n", modeId.c_str());
-                error = ERROR_MODE_FAILED;
-            }
-        } else {
-            Serial.printf("=== sendModeChange() failed, JSON deserialization failed: %s\n", jsonError.c_str());
-            error = ERROR_MODE_FAILED;
+/**
+ * @return The index of the host in the selection, -1 if it is not selected.
+ */
+int findSelected(const std::vector<EvseTarget> &selection, const String &host) {
+    for (size_t i = 0; i < selection.size(); i++) {
+        if (host == selection[i].host) {
+            return static_cast<int>(i);
         }
-    } else {
-        Serial.printf("==== sendModeChange() failed, httpResponseCode: %d\n", httpResponseCode);
-        error = ERROR_MODE_FAILED;
     }
-    http.end();
+    return -1;
 }
 
 /**
- * Scan the network and show the list of SmartEVSE devices found.
- * The user is able to select the device.
+ * Draw a device button, green when the device is selected.
  */
-void drawSmartEvseDeviceSelection() {
-    // Clear screen
-    M5.Display.fillScreen(BACKGROUND_COLOR);
-    M5.Display.setTextColor(TEXT_COLOR);
-    M5.Display.setTextSize(2);
-
-    // Show the loading message.
-    M5.Display.setCursor(0, 0);
-    M5.Display.print("Discovering");
-    M5.Display.setCursor(0, 20);
-    M5.Display.print("SmartEVSE devices.");
-    M5.Display.setCursor(0, 60);
-    M5.Display.print("Please wait...");
-
-    // Get the list of SmartEVSE devices.
-    const auto hosts = discoverMDNS(true);
+void drawDeviceButton(LGFX_Button &button, const String &label, const bool selected, const bool pressed = false) {
+    button.setFillColor(selected ? TFT_GREEN : TFT_DARKGREY);
+    // We use the "long_name" feature by providing the label as a parameter to drawButton.
+    button.drawButton(pressed, label.c_str());
+}
 
-    // Clear the screen again.
+/**
+ * Draw a button per SmartEVSE device, max 4 devices, and the Done button.
+ */
+void drawDeviceButtons(const std::vector<MDNSHost> &hosts, std::vector<LGFX_Button> &deviceButtons,
+                       std::vector<String> &buttonLabels, const std::vector<EvseTarget> &selection,
+                       LGFX_Button &doneButton) {
     M5.Display.fillScreen(BACKGROUND_COLOR);
 
-    if (hosts.empty()) {
-        M5.Display.setCursor(16, 16);
-        M5.Display.print("No SmartEVSE devices \n");
-        M5.Display.print("found.");
-        delay(5000);
-        return;
-    }
-
     // Draw header
     M5.Display.setCursor(16, 16);
-    M5.Display.print("Select device:");
-
-    // Draw the device list, max 4 devices.
-    // Create a vector of buttons for host selection.
-    std::vector<LGFX_Button> deviceButtons;
-    std::vector<String> buttonLabels;
+    M5.Display.print("Select devices:");
+    doneButton.initButton(&M5.Display, static_cast<int16_t>(M5.Display.width() - 56), 20, 80, 32, TFT_WHITE,
+                          0xF680, TFT_BLACK, "Done", 2);
+    doneButton.drawButton(false);
 
     // During the resize process, the default constructor is called for each button,
     // which creates default (uninitialized) objects.
     const unsigned newSize = std::min(hosts.size(), static_cast<size_t>(4));
+    deviceButtons.clear();
     deviceButtons.resize(newSize);
+    buttonLabels.clear();
 
     // Initialize and draw buttons
     int y = 48;
@@ -941,10 +1553,62 @@ void drawSmartEvseDeviceSelection() {
                           longLabel.c_str(), // label
                           2 // text size
         );
-        // We use the "long_name" feature by providing the label as a parameter to drawButton.
-        button.drawButton(false, longLabel.c_str());
+        drawDeviceButton(button, longLabel, findSelected(selection, hosts[i].host) >= 0);
         y += 44;
     }
+}
+
+/**
+ * Scan the network and show the list of SmartEVSE devices found.
+ * Devices are added to the list as they answer. The user selects up to EVSE_MAX_UNITS devices
+ * and confirms with Done. The devices selected before start out selected when they are found.
+ */
+void drawSmartEvseDeviceSelection() {
+    // Read the touch screen here until Done, the touch task waits.
+    std::lock_guard<std::mutex> touchLock(touchMutex);
+
+    // Clear screen
+    M5.Display.fillScreen(BACKGROUND_COLOR);
+    invalidateLcdArea();
+    M5.Display.setTextColor(TEXT_COLOR);
+    M5.Display.setTextSize(2);
+
+    // Show the loading message.
+    M5.Display.setCursor(0, 0);
+    M5.Display.print("Discovering");
+    M5.Display.setCursor(0, 20);
+    M5.Display.print("SmartEVSE devices.");
+    M5.Display.setCursor(0, 60);
+    M5.Display.print("Please wait...");
+
+    // Start a fresh browse, the discovery task runs it.
+    std::vector<MDNSHost> hosts = discoverMDNS(true);
+    uint32_t shownVersion = mdnsBrowser.getVersion();
+
+    // The devices that are selected now, those that are not found again are dropped when Done is pressed.
+    std::vector<EvseTarget> previous(evseTargets, evseTargets + evseTargetCount);
+    std::vector<EvseTarget> selection;
+
+    // Create a vector of buttons for host selection.
+    std::vector<LGFX_Button> deviceButtons;
+    std::vector<String> buttonLabels;
+    LGFX_Button doneButton;
+
+    /**
+     * Select the devices found that were selected before.
+     */
+    auto keepPreviousSelection = [&]() {
+        for (auto &host: hosts) {
+            const int index = findSelected(previous, host.host);
+            if (index >= 0 && findSelected(selection, host.host) < 0) {
+                selection.push_back(previous[index]);
+            }
+        }
+    };
+    if (!hosts.empty()) {
+        keepPreviousSelection();
+        drawDeviceButtons(hosts, deviceButtons, buttonLabels, selection, doneButton);
+    }
 
     // Process any pending touch events and wait for release.
     M5.update();
@@ -952,36 +1616,81 @@ void drawSmartEvseDeviceSelection() {
         M5.update();
     }
 
-    smartEvseHost = "";
-    while (smartEvseHost == "") {
-        M5.update();
-        if (M5.Touch.getCount() > 0) {
-            const auto touchPoint = M5.Touch.getDetail(0);
-            const int16_t touchX = touchPoint.x;
-            const int16_t touchY = touchPoint.y;
-
-            for (auto &button: deviceButtons) {
-                button.press(button.contains(touchX, touchY));
+    for (;;) {
+        // More devices answered, or the browse ended.
+        const uint32_t version = mdnsBrowser.getVersion();
+        if (version != shownVersion) {
+            shownVersion = version;
+            const bool browsing = mdnsBrowser.isBrowsing();
+            const auto found = discoverMDNS();
+            if (found.empty() && !browsing) {
+                M5.Display.fillScreen(BACKGROUND_COLOR);
+                M5.Display.setCursor(16, 16);
+                M5.Display.print("No SmartEVSE devices \n");
+                M5.Display.print("found.");
+                delay(5000);
+                return;
             }
-        } else {
-            for (auto &button: deviceButtons) {
-                button.press(false);
+            // Only redraw when the list changed, so a button being pressed is not drawn over.
+            bool changed = found.size() != hosts.size();
+            for (size_t i = 0; !changed && i < found.size(); i++) {
+                changed = found[i].host != hosts[i].host || found[i].ip != hosts[i].ip;
+            }
+            if (changed) {
+                hosts = found;
+                keepPreviousSelection();
+                drawDeviceButtons(hosts, deviceButtons, buttonLabels, selection, doneButton);
             }
         }
 
+        M5.update();
+        const bool touched = M5.Touch.getCount() > 0;
+        const auto touchPoint = M5.Touch.getDetail(0);
+        for (auto &button: deviceButtons) {
+            button.press(touched && button.contains(touchPoint.x, touchPoint.y));
+        }
+        doneButton.press(touched && !hosts.empty() && doneButton.contains(touchPoint.x, touchPoint.y));
+
         for (size_t i = 0; i < deviceButtons.size(); i++) {
             const String &label = buttonLabels[i];
+            const int selected = findSelected(selection, hosts[i].host);
             if (deviceButtons[i].justPressed()) {
                 playBeep(1000);
-                deviceButtons[i].drawButton(true, label.c_str());
+                drawDeviceButton(deviceButtons[i], label, selected >= 0, true);
             } else if (deviceButtons[i].justReleased()) {
-                deviceButtons[i].drawButton(false, label.c_str());
-                smartEvseHost = hosts[i].host;
-                preferences.putString(PREFERENCES_KEY_EVSE_HOST.c_str(), smartEvseHost);
+                if (selected >= 0) {
+                    selection.erase(selection.begin() + selected);
+                    // Don't select it again when the list is redrawn.
+                    const int previousIndex = findSelected(previous, hosts[i].host);
+                    if (previousIndex >= 0) {
+                        previous.erase(previous.begin() + previousIndex);
+                    }
+                } else if (selection.size() < EVSE_MAX_UNITS) {
+                    EvseTarget target;
+                    copyString(target.host, hosts[i].host.c_str());
+                    // mDNS reports 0.0.0.0 when it has no address record, resolve the host later.
+                    copyString(target.ip, hosts[i].ip != "0.0.0.0" ? hosts[i].ip.c_str() : "");
+                    target.port = hosts[i].port > 0 ? hosts[i].port : 80;
+                    selection.push_back(target);
+                }
+                drawDeviceButton(deviceButtons[i], label, findSelected(selection, hosts[i].host) >= 0);
+            }
+        }
+
+        if (doneButton.justPressed()) {
+            playBeep(1000);
+            doneButton.drawButton(true);
+        } else if (doneButton.justReleased()) {
+            doneButton.drawButton(false);
+            if (!selection.empty()) {
                 break;
             }
         }
     }
+
+    evseTargetCount = selection.size();
+    std::copy(selection.begin(), selection.end(), evseTargets);
+    saveSmartEvseTargets();
     // Clear the screen and return to the loop.
     M5.Display.fillScreen(BACKGROUND_COLOR);
 }
@@ -1016,22 +1725,56 @@ void setup() {
     M5.Speaker.begin();
     M5.Speaker.setVolume(200); // Max volume for beep
 
-    preferences.begin("se-display", false);
-    // Returns an empty String by default if the key doesn't exist.
-    const String ssid = preferences.getString(PREFERENCES_KEY_WIFI_SSID.c_str());
-    const String password = preferences.getString(PREFERENCES_KEY_WIFI_PASSWORD.c_str());
-    smartEvseHost = preferences.getString(PREFERENCES_KEY_EVSE_HOST.c_str());
+    storage.begin("se-display");
+    // Empty strings if the keys don't exist.
+    char ssid[MAX_SSID_LEN + 1];
+    char password[MAX_PASS_LEN + 1];
+    char hosts[EVSE_TARGET_LIST_LEN];
+    char host[EVSE_HOST_LEN];
+    char ip[EVSE_IP_LEN];
+    char port[8];
+    char ttl[12];
+    char pollRates[64];
+    storage.getString(PREFERENCES_KEY_WIFI_SSID.c_str(), ssid, sizeof(ssid));
+    storage.getString(PREFERENCES_KEY_WIFI_PASSWORD.c_str(), password, sizeof(password));
+    storage.getString(PREFERENCES_KEY_EVSE_HOSTS.c_str(), hosts, sizeof(hosts));
+    storage.getString(PREFERENCES_KEY_EVSE_HOST.c_str(), host, sizeof(host));
+    storage.getString(PREFERENCES_KEY_EVSE_IP.c_str(), ip, sizeof(ip));
+    storage.getString(PREFERENCES_KEY_EVSE_PORT.c_str(), port, sizeof(port));
+    storage.getString(PREFERENCES_KEY_SETTINGS_TTL.c_str(), ttl, sizeof(ttl));
+    storage.getString(PREFERENCES_KEY_POLL_RATES.c_str(), pollRates, sizeof(pollRates));
+    evseTargetCount = parseTargetList(hosts, evseTargets, EVSE_MAX_UNITS);
+    if (evseTargetCount == 0 && host[0] != '\0') {
+        // The single unit saved by older firmware.
+        copyString(evseTargets[0].host, host);
+        copyString(evseTargets[0].ip, ip);
+        evseTargets[0].port = atoi(port) > 0 ? atoi(port) : 80;
+        evseTargetCount = 1;
+        saveSmartEvseTargets();
+    }
+    if (atol(ttl) > 0) {
+        settingsTtl = static_cast<uint32_t>(atol(ttl));
+    }
+    PollRates rates = DEFAULT_POLL_RATES;
+    if (parsePollRates(pollRates, rates)) {
+        Serial.printf("==== poll_rates from preferences: %s\n", pollRates);
+        for (auto &poller: evsePollers) {
+            poller.setPollRates(rates);
+        }
+    }
 
-    Serial.printf("==== ssid from preferences: %s\n", ssid != nullptr ? ssid.c_str() : "NULL");
-    Serial.printf("==== password from preferences: %s\n", password != nullptr ? password.c_str() : "NULL");
-    Serial.printf("==== smartevse_host from preferences: %s\n",
-                  smartEvseHost != nullptr ? smartEvseHost.c_str() : "NULL");
+    Serial.printf("==== ssid from preferences: %s\n", ssid);
+    Serial.printf("==== password from preferences: %s\n", password);
+    for (size_t i = 0; i < evseTargetCount; i++) {
+        Serial.printf("==== smartevse_hosts from preferences: %s (%s:%u)\n", evseTargets[i].host, evseTargets[i].ip,
+                      evseTargets[i].port);
+    }
 
     // Connect to WiFi; try three times max.
-    if (!ssid.isEmpty()) {
+    if (ssid[0] != '\0') {
         int retries = 3;
         while (retries > 0) {
-            wifiConnected = connectToWiFi(ssid, password != nullptr ? password : "");
+            wifiConnected = connectToWiFi(ssid, password);
             if (wifiConnected) {
                 break;
             }
@@ -1053,34 +1796,100 @@ void setup() {
     }
 
     if (retries <= 0) {
-        error = "Error starting mDNS";
+        error = EVSE_ERROR_MDNS;
     } else {
         MDNS.addService("http", "tcp", 80); // announce Web server
     }
 
     startWebserver();
 
+    // Browses run in the background, the web server and the UI share them.
+    xTaskCreatePinnedToCore(discoveryTask, "discovery", DISCOVERY_TASK_STACK_SIZE, nullptr, 1, &discoveryTaskHandle,
+                            NETWORK_TASK_CORE);
+
     initButtons();
+    initWidgets();
+    initPlaceholder();
 
     if (wifiConnected) {
-        fetchSmartEVSEData();
-        if (evseConnected) {
-            drawSolarButton(false);
-            drawSmartButton(false);
-        } else {
-            drawConfigButton(false);
+        // The network tasks are not running yet, so poll the first unit once here to draw the right buttons.
+        targetSmartEvse();
+        evseFleet.currentPoller().poll();
+        if (evseFleet.consumeSnapshots() != 0) {
+            applyEvseSnapshot(evseFleet.currentPoller().snapshot());
+            drawFleetStatus();
         }
+        if (!evseConnected) {
+            showButtons(false);
+        }
+
+        // From here on, all SmartEVSE network I/O happens on the network tasks.
+        startNetworkTasks();
     }
+
+    // From here on, loop() runs without heap allocations while it only renders.
+    watchAllocations();
+
+    // From here on, the touch task reads the touch screen and loop() only draws while holding displayMutex.
+    touchEvents = xQueueCreate(TOUCH_EVENT_QUEUE_LENGTH, sizeof(TouchEvent));
+    xTaskCreatePinnedToCore(touchTask, "touch", TOUCH_TASK_STACK_SIZE, nullptr, TOUCH_TASK_PRIORITY, &touchTaskHandle,
+                            TOUCH_TASK_CORE);
 }
 
+/**
+ * Act on a touch the touch task already gave feedback for.
+ */
+void handleTouchEvent(const TouchEvent &event) {
+    switch (event.action) {
+        case TOUCH_SOLAR:
+        case TOUCH_SMART:
+            Serial.printf("==== handleTouchEvent() solar- or smartButton released\n");
+            evseFleet.currentPoller().requestModeChange(event.action == TOUCH_SOLAR ? EVSE_MODE_SOLAR
+                                                                                    : EVSE_MODE_SMART);
+            break;
+        case TOUCH_CONFIG:
+            Serial.printf("==== handleTouchEvent() configButton released\n");
+            drawSmartEvseDeviceSelection();
+            compositor.invalidate();
+            targetSmartEvse();
+            startNetworkTasks();
 
-static unsigned long lastCheck1S = 0;
-static unsigned long lastCheck3S = 0;
+            // Clear errors and buttons.
+            error = EVSE_ERROR_NONE;
+            clearButtonsArea();
+            evseConnected = false;
+            drawStatus();
+            break;
+        case TOUCH_SWIPE_NEXT:
+        case TOUCH_SWIPE_PREVIOUS:
+            if (evseFleet.swipe(event.action == TOUCH_SWIPE_NEXT ? 1 : -1)) {
+                showCurrentUnit();
+                M5.Display.waitDisplay();
+                metrics.record(STAGE_TOUCH_TO_PIXELS, micros() - event.detectedAt);
+            }
+            break;
+    }
+}
+
+/**
+ * Count heap allocations in a loop() iteration that only rendered polled state, which works on
+ * fixed buffers. Only counted in [env:m5stack-core2-alloc-check] builds, which keep running unless
+ * ALLOC_CHECK_ABORT is defined too.
+ */
+void checkSteadyState(const uint32_t allocations) {
+    if (allocations == 0) {
+        return;
+    }
+    steadyStateAllocations += allocations;
+    Serial.printf("==== loop() allocated %u times while rendering\n", static_cast<unsigned>(allocations));
+#ifdef ALLOC_CHECK_ABORT
+    assert(false && "steady-state allocation");
+#endif
+}
 
 // ---- Main Loop ----
 void loop() {
-    // Update touch and button states.
-    M5.update();
+    StageTimer loopTimer(&metrics, STAGE_LOOP);
 
     // Reboot device?
     if (reboot) {
@@ -1092,88 +1901,57 @@ void loop() {
 
     // Must be called frequently.
     if (dnsServerRunning) {
+        StageTimer timer(&metrics, STAGE_DNS);
         dnsServer.processNextRequest();
     }
+    updateWifiScan();
 
     if (wifiConnected) {
-        // Check for touch events for the three buttons.
-        const bool touchDetected = M5.Touch.getCount() > 0;
-        handleTouchInput(touchDetected);
+        std::lock_guard<std::mutex> lock(displayMutex);
+
+        // The touches the touch task handed over.
+        TouchEvent event;
+        bool steady = true;
+        while (xQueueReceive(touchEvents, &event, 0) == pdTRUE) {
+            handleTouchEvent(event);
+            steady = false;
+        }
 
-        // Draw and update buttons.
-        if (solarButton.justPressed()) {
-            Serial.printf("==== Loop - solarButton.justPressed()\n");
-            playBeep(1000);
-            mode = "Solar";
-            drawSolarButton(true);
+        // Render whatever the network tasks published since the previous iteration.
+        // While connected, with nothing touched, this runs without heap allocations.
+        steady = steady && evseConnected;
+        const uint32_t allocations = getAllocationCount();
+        EvsePoller &poller = evseFleet.currentPoller();
+        if (poller.consumeFrame()) {
+            // Unless it was decoded at boot, the placeholder image is decoded on the heap.
+            steady = steady && (poller.frame().valid || placeholderDecoded);
+            drawSmartEvseDisplay(poller.frame());
+            publishFrame(poller.frame());
         }
-        if (smartButton.justPressed()) {
-            Serial.printf("==== Loop - smartButton.justPressed()\n");
-            playBeep(2000);
-            mode = "Smart";
-            drawSmartButton(true);
+        const uint32_t changed = evseFleet.consumeSnapshots();
+        if (changed & (1u << evseFleet.getCurrent())) {
+            applyEvseSnapshot(poller.snapshot());
+            publishEvents(poller.snapshot());
         }
-        const bool solarButtonReleased = solarButton.justReleased();
-        const bool smartButtonReleased = smartButton.justReleased();
-        if (solarButtonReleased || smartButtonReleased) {
-            Serial.printf("==== Loop - solar- or smartButton.justReleased()\n");
-            // Update the active state of both buttons.
-            drawSolarButton(false);
-            drawSmartButton(false);
-
-            sendModeChange(solarButtonReleased ? "2" : "3");
+        if (changed != 0) {
+            drawFleetStatus();
         }
-        if (configButton.justPressed()) {
-            Serial.printf("==== Loop - configButton.justPressed()\n");
-            playBeep(1000);
-            drawConfigButton(true);
+        composeWidgets();
+        if (steady && evseConnected) {
+            checkSteadyState(getAllocationCount() - allocations);
         }
-        if (configButton.justReleased()) {
-            Serial.printf("==== Loop - configButton.justReleased()\n");
-            drawConfigButton(false);
-            drawSmartEvseDeviceSelection();
-
-            // Clear errors and buttons.
-            error = "";
-            clearButtonsArea();
-            evseConnected = false;
-            drawStatus();
-        }
-
-        // Update every second.
-        if (millis() - lastCheck1S >= 1000) {
-            lastCheck1S = millis();
-            Serial.printf("==== Loop 1s - drawSmartEVSEDisplay...\n");
-            drawSmartEvseDisplay();
-        }
-
-        if (millis() - lastCheck3S >= 3000) {
-            lastCheck3S = millis();
-            Serial.printf("==== Loop 3s - Fetching data...\n");
-
-            // Improvement? Move fetchSmartEVSEData() to FreeRTOS task?
-            const bool previousEvseConnected = evseConnected;
-            const String previousMode = mode;
-            fetchSmartEVSEData();
-            drawStatus();
-
-            // If the status of the SmartEVSE is changed, update the buttons accordingly.
-            if (evseConnected != previousEvseConnected) {
-                clearButtonsArea();
-                if (evseConnected) {
-                    drawSolarButton(false);
-                    drawSmartButton(false);
-                } else {
-                    drawConfigButton(false);
-                }
-            }
 
-            // If the mode changed, update the outline of the border,
-            if (mode != previousMode) {
-                drawSolarButton();
-                drawSmartButton();
+        // A SmartEVSE got a new address, remember it for the next boot.
+        for (size_t i = 0; i < evseFleet.getCount(); i++) {
+            if (evsePollers[i].consumeResolvedTarget() &&
+                strcmp(evseTargets[i].host, evsePollers[i].resolvedTarget().host) == 0) {
+                evseTargets[i] = evsePollers[i].resolvedTarget();
+                saveSmartEvseTargets();
             }
         }
     }
+    pingEventClients();
+    checkLongPolls();
+    wakeWebServer();
 }
 #endif // UNIT_TEST
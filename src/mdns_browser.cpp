@@ -0,0 +1,112 @@
+#include "mdns_browser.h"
+
+#include <cstring>
+
+#include "log.h"
+
+// A browse is a number of short queries, each returning the hosts that answered so far.
+constexpr int BROWSE_ROUNDS = 12;
+constexpr uint32_t BROWSE_ROUND_TIMEOUT = 250;
+// The hosts found are reused for this long.
+constexpr uint32_t BROWSE_INTERVAL = 30000;
+
+MdnsBrowser::MdnsBrowser(hal::Discovery &discovery, hal::Clock &clock, const char *hostPrefix)
+    : discovery(discovery), clock(clock), hostPrefix(hostPrefix), hosts(), seen(), hostCount(0), requested(false),
+      browsing(false), round(0), browsed(false), lastBrowse(0), version(0) {
+}
+
+void MdnsBrowser::request(const bool forceFresh) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (browsing || requested) {
+        return;
+    }
+    if (!forceFresh && browsed && clock.millis() - lastBrowse < BROWSE_INTERVAL) {
+        return;
+    }
+    requested = true;
+    version++;
+}
+
+size_t MdnsBrowser::getHosts(hal::DiscoveredHost *found, const size_t maxHosts) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t count = hostCount < maxHosts ? hostCount : maxHosts;
+    for (size_t i = 0; i < count; i++) {
+        found[i] = hosts[i];
+    }
+    return count;
+}
+
+bool MdnsBrowser::isBrowsing() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return browsing || requested;
+}
+
+uint32_t MdnsBrowser::getVersion() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return version;
+}
+
+bool MdnsBrowser::step() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (requested) {
+            requested = false;
+            browsing = true;
+            round = 0;
+            memset(seen, 0, sizeof(seen));
+        }
+        if (!browsing) {
+            return false;
+        }
+    }
+
+    // Query without holding the lock, this takes up to BROWSE_ROUND_TIMEOUT.
+    hal::DiscoveredHost found[MDNS_BROWSER_MAX_HOSTS];
+    const size_t n = discovery.browse("http", "tcp", found, MDNS_BROWSER_MAX_HOSTS, BROWSE_ROUND_TIMEOUT);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < n; i++) {
+        if (strncmp(found[i].host, hostPrefix, strlen(hostPrefix)) == 0) {
+            addHost(found[i]);
+        }
+    }
+    if (++round >= BROWSE_ROUNDS) {
+        finishBrowse();
+    }
+    return true;
+}
+
+void MdnsBrowser::addHost(const hal::DiscoveredHost &host) {
+    for (size_t i = 0; i < hostCount; i++) {
+        if (strcmp(hosts[i].host, host.host) == 0) {
+            if (strcmp(hosts[i].ip, host.ip) != 0 || hosts[i].port != host.port) {
+                hosts[i] = host;
+                version++;
+            }
+            seen[i] = true;
+            return;
+        }
+    }
+    if (hostCount < MDNS_BROWSER_MAX_HOSTS) {
+        LOG_PRINTF("==== MdnsBrowser found %s (%s:%u)\n", host.host, host.ip, static_cast<unsigned>(host.port));
+        hosts[hostCount] = host;
+        seen[hostCount] = true;
+        hostCount++;
+        version++;
+    }
+}
+
+void MdnsBrowser::finishBrowse() {
+    // Drop the hosts of the previous browse that did not answer this time.
+    size_t kept = 0;
+    for (size_t i = 0; i < hostCount; i++) {
+        if (seen[i]) {
+            hosts[kept++] = hosts[i];
+        }
+    }
+    hostCount = kept;
+    browsing = false;
+    browsed = true;
+    lastBrowse = clock.millis();
+    version++;
+}
@@ -0,0 +1,80 @@
+#ifndef MDNS_BROWSER_H
+#define MDNS_BROWSER_H
+
+#include <mutex>
+
+#include "hal.h"
+
+// Hosts the browser keeps.
+#define MDNS_BROWSER_MAX_HOSTS 16
+
+/**
+ * Browses for SmartEVSE devices in the background.
+ *
+ * Any task may ask for a browse with request() and read the hosts found so far. Only one browse
+ * runs at a time and concurrent requests share it. The browse runs on the discovery task in
+ * short rounds, so the hosts that answer show up after the round they answered in.
+ */
+class MdnsBrowser {
+public:
+    /**
+     * @param hostPrefix Only hosts with a name starting with this are kept, like "SmartEVSE-".
+     */
+    MdnsBrowser(hal::Discovery &discovery, hal::Clock &clock, const char *hostPrefix);
+
+    // ---- Any task ----
+
+    /**
+     * Ask for a browse, unless one is running or the last one is recent.
+     *
+     * @param forceFresh Browse even if the last browse is recent.
+     */
+    void request(bool forceFresh = false);
+
+    /**
+     * Copy the hosts found so far.
+     *
+     * @return The number of hosts written to hosts.
+     */
+    size_t getHosts(hal::DiscoveredHost *hosts, size_t maxHosts) const;
+
+    bool isBrowsing() const;
+
+    /**
+     * @return A number that changes whenever the hosts or isBrowsing() change.
+     */
+    uint32_t getVersion() const;
+
+    // ---- Discovery task ----
+
+    /**
+     * Run one round of the browse in progress.
+     *
+     * @return False if there is no browse to run.
+     */
+    bool step();
+
+private:
+    hal::Discovery &discovery;
+    hal::Clock &clock;
+    const char *hostPrefix;
+
+    mutable std::mutex mutex;
+    // Guarded by mutex.
+    hal::DiscoveredHost hosts[MDNS_BROWSER_MAX_HOSTS];
+    // Hosts that answered in the current browse, the others are dropped when it ends.
+    bool seen[MDNS_BROWSER_MAX_HOSTS];
+    size_t hostCount;
+    bool requested;
+    bool browsing;
+    int round;
+    bool browsed;
+    uint32_t lastBrowse;
+    uint32_t version;
+
+    void addHost(const hal::DiscoveredHost &host);
+
+    void finishBrowse();
+};
+
+#endif // MDNS_BROWSER_H
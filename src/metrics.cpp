@@ -0,0 +1,142 @@
+#include "metrics.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+// The Prometheus text goes out in pieces of up to this many bytes.
+constexpr size_t METRICS_CHUNK_SIZE = 512;
+
+static const char *const STAGE_NAMES[METRIC_STAGE_COUNT] = {
+    "http_connect", "http_first_byte", "http_body", "json_parse", "bmp_decode", "lcd_blit", "lcd_spi_wait",
+    "draw_status", "dns", "loop", "touch_to_beep", "touch_to_pixels"
+};
+
+namespace {
+    /**
+     * Collects lines and hands them to the write function a chunk at a time.
+     */
+    class ChunkWriter {
+    public:
+        ChunkWriter(const Metrics::WriteFunction write, void *context) : write(write), context(context), length(0) {
+        }
+
+        void printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+            char line[160];
+            va_list args;
+            va_start(args, format);
+            const int written = vsnprintf(line, sizeof(line), format, args);
+            va_end(args);
+            if (written <= 0) {
+                return;
+            }
+            const size_t lineLength = static_cast<size_t>(written) < sizeof(line) ? written : sizeof(line) - 1;
+            if (length + lineLength > sizeof(buffer)) {
+                flush();
+            }
+            memcpy(buffer + length, line, lineLength);
+            length += lineLength;
+        }
+
+        void flush() {
+            if (length > 0) {
+                write(context, buffer, length);
+                length = 0;
+            }
+        }
+
+    private:
+        Metrics::WriteFunction write;
+        void *context;
+        char buffer[METRICS_CHUNK_SIZE];
+        size_t length;
+    };
+}
+
+void Metrics::countHttpResponse(const int code) {
+    for (size_t i = 0; i < METRICS_HTTP_CODES; i++) {
+        int slotCode = httpCodes[i].load();
+        // Claim a free slot, another task may claim it first.
+        if (slotCode == 0 && httpCodes[i].compare_exchange_strong(slotCode, code)) {
+            slotCode = code;
+        }
+        if (slotCode == code) {
+            httpCounts[i].fetch_add(1);
+            return;
+        }
+    }
+    otherHttpCount.fetch_add(1);
+}
+
+void Metrics::writePrometheus(const HeapStats &heap, const CompositorStats &widgets, const WriteFunction write,
+                              void *context) const {
+    ChunkWriter out(write, context);
+
+    out.printf("# HELP smartevse_display_stage_seconds Time spent per stage. "
+               "JSON is parsed while it is read from the socket, so json_parse includes http_body.\n");
+    out.printf("# TYPE smartevse_display_stage_seconds histogram\n");
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; stage++) {
+        const LatencySummary summary = stages[stage].getSummary();
+        const char *name = STAGE_NAMES[stage];
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+            cumulative += summary.buckets[i];
+            const uint32_t bound = LatencyHistogram::BOUNDS[i];
+            out.printf("smartevse_display_stage_seconds_bucket{stage=\"%s\",le=\"%u.%06u\"} %u\n", name,
+                       static_cast<unsigned>(bound / 1000000), static_cast<unsigned>(bound % 1000000),
+                       static_cast<unsigned>(cumulative));
+        }
+        out.printf("smartevse_display_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %u\n", name,
+                   static_cast<unsigned>(summary.count));
+        out.printf("smartevse_display_stage_seconds_sum{stage=\"%s\"} %u.%06u\n", name,
+                   static_cast<unsigned>(summary.sum / 1000000), static_cast<unsigned>(summary.sum % 1000000));
+        out.printf("smartevse_display_stage_seconds_count{stage=\"%s\"} %u\n", name,
+                   static_cast<unsigned>(summary.count));
+    }
+
+    out.printf("# HELP smartevse_display_http_responses_total Responses of the SmartEVSE by status code, "
+               "negative codes are requests that failed.\n");
+    out.printf("# TYPE smartevse_display_http_responses_total counter\n");
+    for (size_t i = 0; i < METRICS_HTTP_CODES; i++) {
+        const int code = httpCodes[i].load();
+        if (code != 0) {
+            out.printf("smartevse_display_http_responses_total{code=\"%d\"} %u\n", code,
+                       static_cast<unsigned>(httpCounts[i].load()));
+        }
+    }
+    if (otherHttpCount.load() != 0) {
+        out.printf("smartevse_display_http_responses_total{code=\"other\"} %u\n",
+                   static_cast<unsigned>(otherHttpCount.load()));
+    }
+
+    out.printf("# HELP smartevse_display_heap_free_bytes Free heap.\n");
+    out.printf("# TYPE smartevse_display_heap_free_bytes gauge\n");
+    out.printf("smartevse_display_heap_free_bytes %u\n", static_cast<unsigned>(heap.free));
+    out.printf("# HELP smartevse_display_heap_min_free_bytes Lowest free heap since boot.\n");
+    out.printf("# TYPE smartevse_display_heap_min_free_bytes gauge\n");
+    out.printf("smartevse_display_heap_min_free_bytes %u\n", static_cast<unsigned>(heap.minFree));
+    out.printf("# HELP smartevse_display_heap_largest_free_block_bytes Largest block that can be allocated.\n");
+    out.printf("# TYPE smartevse_display_heap_largest_free_block_bytes gauge\n");
+    out.printf("smartevse_display_heap_largest_free_block_bytes %u\n", static_cast<unsigned>(heap.largestFreeBlock));
+    out.printf("# HELP smartevse_display_steady_state_allocations_total Heap allocations while loop() only rendered "
+               "polled state, counted in alloc-check builds.\n");
+    out.printf("# TYPE smartevse_display_steady_state_allocations_total counter\n");
+    out.printf("smartevse_display_steady_state_allocations_total %u\n",
+               static_cast<unsigned>(heap.steadyStateAllocations));
+    out.printf("# HELP smartevse_display_json_arena_fallbacks_total JSON allocations that did not fit their fixed "
+               "buffer and went to the heap.\n");
+    out.printf("# TYPE smartevse_display_json_arena_fallbacks_total counter\n");
+    out.printf("smartevse_display_json_arena_fallbacks_total %u\n", static_cast<unsigned>(heap.jsonArenaFallbacks));
+
+    out.printf("# HELP smartevse_display_widget_renders_total Status bar and button widgets drawn again because "
+               "their value changed.\n");
+    out.printf("# TYPE smartevse_display_widget_renders_total counter\n");
+    out.printf("smartevse_display_widget_renders_total %u\n", static_cast<unsigned>(widgets.widgetsRendered));
+    out.printf("# HELP smartevse_display_widget_pixels_pushed_total Pixels of the widgets pushed to the display.\n");
+    out.printf("# TYPE smartevse_display_widget_pixels_pushed_total counter\n");
+    out.printf("smartevse_display_widget_pixels_pushed_total %u\n", static_cast<unsigned>(widgets.pixelsPushed));
+    out.printf("# HELP smartevse_display_widget_pixels_per_second Pixels of the widgets pushed in the last second.\n");
+    out.printf("# TYPE smartevse_display_widget_pixels_per_second gauge\n");
+    out.printf("smartevse_display_widget_pixels_per_second %u\n", static_cast<unsigned>(widgets.pixelsPerSecond));
+    out.flush();
+}
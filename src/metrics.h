@@ -0,0 +1,123 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+#include "latency_histogram.h"
+#include "widget.h"
+
+// Distinct HTTP status codes counted, later ones are counted as "other".
+#define METRICS_HTTP_CODES 12
+
+enum MetricStage {
+    // Opening a connection to the SmartEVSE.
+    STAGE_HTTP_CONNECT,
+    // Sending a request until the headers of the response are in.
+    STAGE_HTTP_FIRST_BYTE,
+    // Waiting for the body of a response.
+    STAGE_HTTP_BODY,
+    STAGE_JSON_PARSE,
+    STAGE_BMP_DECODE,
+    // Pushing the LCD mirror to the display.
+    STAGE_LCD_BLIT,
+    // The part of STAGE_LCD_BLIT the CPU waits for the display to take the pixels.
+    STAGE_LCD_SPI_WAIT,
+    STAGE_DRAW_STATUS,
+    // Handling the DNS server of the captive portal, once per loop().
+    STAGE_DNS,
+    // One iteration of loop().
+    STAGE_LOOP,
+    STAGE_TOUCH_TO_BEEP,
+    STAGE_TOUCH_TO_PIXELS,
+    METRIC_STAGE_COUNT
+};
+
+/**
+ * The heap, as ESP.getFreeHeap(), getMinFreeHeap() and getMaxAllocHeap() report it.
+ */
+struct HeapStats {
+    uint32_t free;
+    uint32_t minFree;
+    uint32_t largestFreeBlock;
+    // Allocations where loop() should make none, only counted in builds with ALLOC_COUNTER.
+    uint32_t steadyStateAllocations;
+    // JSON documents that did not fit their JsonArena and went to the heap.
+    uint32_t jsonArenaFallbacks;
+};
+
+/**
+ * Where the time goes, per stage, and how the SmartEVSE answers. Safe from any task.
+ */
+class Metrics {
+public:
+    /**
+     * Receives the Prometheus text, in pieces.
+     */
+    typedef void (*WriteFunction)(void *context, const char *text, size_t length);
+
+    explicit Metrics(hal::Clock &clock) : clock(clock), httpCodes(), httpCounts(), otherHttpCount(0) {
+    }
+
+    uint32_t micros() {
+        return clock.micros();
+    }
+
+    void record(MetricStage stage, uint32_t us) {
+        stages[stage].record(us);
+    }
+
+    const LatencyHistogram &histogram(const MetricStage stage) const {
+        return stages[stage];
+    }
+
+    /**
+     * Count a response of the SmartEVSE.
+     *
+     * @param code The HTTP status code, or the negative error of a request that failed.
+     */
+    void countHttpResponse(int code);
+
+    /**
+     * Write all metrics in the Prometheus text exposition format.
+     */
+    void writePrometheus(const HeapStats &heap, const CompositorStats &widgets, WriteFunction write,
+                         void *context) const;
+
+private:
+    hal::Clock &clock;
+    LatencyHistogram stages[METRIC_STAGE_COUNT];
+    // 0 for a free slot.
+    std::atomic<int> httpCodes[METRICS_HTTP_CODES];
+    std::atomic<uint32_t> httpCounts[METRICS_HTTP_CODES];
+    std::atomic<uint32_t> otherHttpCount;
+};
+
+/**
+ * Records the time from construction to destruction as a stage. Does nothing without metrics.
+ */
+class StageTimer {
+public:
+    StageTimer(Metrics *metrics, const MetricStage stage)
+        : metrics(metrics), stage(stage), start(metrics != nullptr ? metrics->micros() : 0) {
+    }
+
+    StageTimer(const StageTimer &) = delete;
+
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    ~StageTimer() {
+        if (metrics != nullptr) {
+            metrics->record(stage, metrics->micros() - start);
+        }
+    }
+
+private:
+    Metrics *metrics;
+    MetricStage stage;
+    uint32_t start;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,91 @@
+#ifndef MONO_BLITTER_H
+#define MONO_BLITTER_H
+
+#include <cstdint>
+#include <cstring>
+
+enum BitOrder {
+    // The leftmost pixel is the most significant bit, as in BMP files.
+    BIT_ORDER_MSB_FIRST,
+    BIT_ORDER_LSB_FIRST
+};
+
+/**
+ * A MonoBlitter specialization, for code that picks the scale at runtime.
+ */
+struct RowBlitter {
+    int scale;
+
+    /**
+     * Expand one source row horizontally, see MonoBlitter::expandRow().
+     */
+    void (*expandRow)(const uint8_t *row, int width, uint16_t *out);
+};
+
+/**
+ * Expands 1 bit per pixel rows to RGB565, scaled by an integer factor.
+ *
+ * Scale, bit order and colors are template parameters, so each specialization gets its own
+ * lookup table of pixel runs: every nibble of the source expands with one table copy
+ * of 4 * Scale pixels, instead of testing every bit.
+ */
+template<int Scale, BitOrder Order, uint16_t Foreground, uint16_t Background>
+class MonoBlitter {
+public:
+    static_assert(Scale >= 1 && Scale <= 4, "Scale must be 1, 2, 3 or 4");
+
+    static const int SCALE = Scale;
+
+    /**
+     * Expand one row horizontally.
+     *
+     * @param row The source row, (width + 7) / 8 bytes.
+     * @param out Receives the pixels, room for (width + 7) / 8 * 8 * Scale pixels.
+     */
+    static void expandRow(const uint8_t *row, const int width, uint16_t *out) {
+        const Table &runs = table();
+        const int bytes = (width + 7) / 8;
+        for (int col = 0; col < bytes; ++col) {
+            const uint8_t byte = row[col];
+            const uint8_t first = Order == BIT_ORDER_MSB_FIRST ? byte >> 4 : byte & 0x0f;
+            const uint8_t second = Order == BIT_ORDER_MSB_FIRST ? byte & 0x0f : byte >> 4;
+            memcpy(out, runs.pixels[first], sizeof(runs.pixels[first]));
+            memcpy(out + RUN_LENGTH, runs.pixels[second], sizeof(runs.pixels[second]));
+            out += 2 * RUN_LENGTH;
+        }
+    }
+
+    static const RowBlitter &rowBlitter() {
+        static const RowBlitter blitter = {Scale, &expandRow};
+        return blitter;
+    }
+
+private:
+    // Pixels a nibble expands to.
+    static const int RUN_LENGTH = 4 * Scale;
+
+    struct Table {
+        uint16_t pixels[16][RUN_LENGTH];
+    };
+
+    static Table buildTable() {
+        Table runs;
+        for (int nibble = 0; nibble < 16; ++nibble) {
+            for (int i = 0; i < 4; ++i) {
+                const int bit = Order == BIT_ORDER_MSB_FIRST ? 3 - i : i;
+                const uint16_t color = (nibble >> bit) & 1 ? Foreground : Background;
+                for (int s = 0; s < Scale; ++s) {
+                    runs.pixels[nibble][i * Scale + s] = color;
+                }
+            }
+        }
+        return runs;
+    }
+
+    static const Table &table() {
+        static const Table runs = buildTable();
+        return runs;
+    }
+};
+
+#endif // MONO_BLITTER_H
@@ -0,0 +1,153 @@
+#include "poll_scheduler.h"
+
+#include <cstdlib>
+
+#include "log.h"
+
+// Poll fast this long after the LCD changed or the mode was changed here.
+constexpr uint32_t FAST_HOLD = 10000;
+// Slow down when the LCD did not change for this long.
+constexpr uint32_t IDLE_AFTER = 60000;
+constexpr uint32_t STATS_WINDOW = 10000;
+
+constexpr size_t LCD_RATES = 0;
+constexpr size_t SETTINGS_RATES = 3;
+
+PollScheduler::PollScheduler(hal::Clock &clock, const PollRates &rates)
+    : clock(clock), lcdPolled(false), settingsPolled(false), reachable(true), charging(false), lastLcdPoll(0),
+      lastSettingsPoll(0), lastChange(0), boostedUntil(0), windowStart(0), frames(0), lcdRequests(0),
+      settingsRequests(0), framesRate(0), lcdRate(0), settingsRate(0), lastPace(POLL_PACE_NORMAL) {
+    setRates(rates);
+    reset();
+}
+
+void PollScheduler::setRates(const PollRates &newRates) {
+    const uint32_t values[6] = {newRates.lcdFast, newRates.lcdNormal, newRates.lcdIdle, newRates.settingsFast,
+                                newRates.settingsNormal, newRates.settingsIdle};
+    for (size_t i = 0; i < 6; i++) {
+        rates[i].store(values[i]);
+    }
+}
+
+void PollScheduler::boost() {
+    boostedUntil = clock.millis() + FAST_HOLD;
+}
+
+void PollScheduler::reset() {
+    const uint32_t now = clock.millis();
+    lcdPolled = false;
+    settingsPolled = false;
+    reachable = true;
+    charging = false;
+    // Not a recent change, and not idle yet.
+    lastChange = now - FAST_HOLD;
+    boostedUntil = now;
+    windowStart = now;
+    frames = 0;
+    lcdRequests = 0;
+    settingsRequests = 0;
+}
+
+PollPace PollScheduler::getPace() {
+    const uint32_t now = clock.millis();
+    PollPace pace;
+    if (static_cast<int32_t>(boostedUntil - now) > 0) {
+        pace = POLL_PACE_FAST;
+    } else if (!reachable) {
+        pace = POLL_PACE_IDLE;
+    } else if (charging || now - lastChange < FAST_HOLD) {
+        pace = POLL_PACE_FAST;
+    } else if (now - lastChange >= IDLE_AFTER) {
+        pace = POLL_PACE_IDLE;
+    } else {
+        pace = POLL_PACE_NORMAL;
+    }
+    if (lastPace.exchange(pace) != pace) {
+        LOG_PRINTF("==== PollScheduler pace: %d\n", pace);
+    }
+    return pace;
+}
+
+uint32_t PollScheduler::interval(const size_t first) {
+    return rates[first + getPace()].load();
+}
+
+bool PollScheduler::lcdDue() {
+    return !lcdPolled || clock.millis() - lastLcdPoll >= interval(LCD_RATES);
+}
+
+bool PollScheduler::settingsDue() {
+    return !settingsPolled || clock.millis() - lastSettingsPoll >= interval(SETTINGS_RATES);
+}
+
+void PollScheduler::lcdFetched(const bool lcdReachable, const bool changed) {
+    lcdPolled = true;
+    lastLcdPoll = clock.millis();
+    reachable = lcdReachable;
+    lcdRequests++;
+    if (changed) {
+        lastChange = lastLcdPoll;
+        frames++;
+    }
+    updateStats();
+}
+
+void PollScheduler::settingsFetched(const bool settingsReachable, const bool isCharging) {
+    settingsPolled = true;
+    lastSettingsPoll = clock.millis();
+    reachable = settingsReachable;
+    charging = settingsReachable && isCharging;
+    settingsRequests++;
+    updateStats();
+}
+
+/**
+ * Thousandths per second.
+ */
+static uint32_t ratePerSecond(const uint32_t count, const uint32_t elapsed) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(count) * 1000000 / elapsed);
+}
+
+void PollScheduler::updateStats() {
+    const uint32_t elapsed = clock.millis() - windowStart.load();
+    if (elapsed < STATS_WINDOW) {
+        return;
+    }
+    framesRate.store(ratePerSecond(frames.load(), elapsed));
+    lcdRate.store(ratePerSecond(lcdRequests.load(), elapsed));
+    settingsRate.store(ratePerSecond(settingsRequests.load(), elapsed));
+    LOG_PRINTF("==== PollScheduler fps: %.2f, requests/s: %.2f lcd + %.2f settings, pace: %d\n",
+               framesRate.load() / 1000.0, lcdRate.load() / 1000.0, settingsRate.load() / 1000.0, lastPace.load());
+    windowStart = clock.millis();
+    frames = 0;
+    lcdRequests = 0;
+    settingsRequests = 0;
+}
+
+PollStats PollScheduler::getStats() const {
+    // Without requests, no window is closed: count the one that ran out up to now, so the rates of a
+    // SmartEVSE that stopped answering, or whose breaker is open, drop to 0.
+    const uint32_t elapsed = clock.millis() - windowStart.load();
+    if (elapsed >= STATS_WINDOW) {
+        return {static_cast<PollPace>(lastPace.load()), ratePerSecond(frames.load(), elapsed) / 1000.0f,
+                ratePerSecond(lcdRequests.load(), elapsed) / 1000.0f,
+                ratePerSecond(settingsRequests.load(), elapsed) / 1000.0f};
+    }
+    return {static_cast<PollPace>(lastPace.load()), framesRate.load() / 1000.0f, lcdRate.load() / 1000.0f,
+            settingsRate.load() / 1000.0f};
+}
+
+bool parsePollRates(const char *list, PollRates &rates) {
+    uint32_t values[6];
+    for (size_t i = 0; i < 6; i++) {
+        char *end;
+        const long value = strtol(list, &end, 10);
+        if (end == list || value <= 0 || *end != (i < 5 ? ',' : '\0')) {
+            return false;
+        }
+        values[i] = static_cast<uint32_t>(value);
+        list = end + 1;
+    }
+    rates = {values[0], values[1], values[2], values[3], values[4], values[5]};
+    return true;
+}
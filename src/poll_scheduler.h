@@ -0,0 +1,138 @@
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+
+/**
+ * The polling intervals in ms, per pace.
+ */
+struct PollRates {
+    uint32_t lcdFast;
+    uint32_t lcdNormal;
+    uint32_t lcdIdle;
+    uint32_t settingsFast;
+    uint32_t settingsNormal;
+    uint32_t settingsIdle;
+};
+
+// The intervals of the fixed timers this replaces are the normal pace.
+constexpr PollRates DEFAULT_POLL_RATES = {500, 1000, 3000, 1000, 3000, 10000};
+
+enum PollPace {
+    // Charging, the LCD changed recently or the mode was just changed.
+    POLL_PACE_FAST,
+    POLL_PACE_NORMAL,
+    // Nothing changed for a while, or the SmartEVSE does not answer.
+    POLL_PACE_IDLE
+};
+
+/**
+ * What the polling achieved over the last STATS_WINDOW, per second.
+ */
+struct PollStats {
+    PollPace pace;
+    // LCD frames that differed from the previous one.
+    float framesPerSecond;
+    float lcdRequestsPerSecond;
+    float settingsRequestsPerSecond;
+};
+
+/**
+ * Decides when the poller fetches /lcd and /settings, faster while something happens on the
+ * SmartEVSE and slower while nothing does.
+ *
+ * Runs on the network task, except setRates() and getStats() which are safe from any task.
+ */
+class PollScheduler {
+public:
+    PollScheduler(hal::Clock &clock, const PollRates &rates);
+
+    /**
+     * Poll at these intervals from the next poll on.
+     */
+    void setRates(const PollRates &rates);
+
+    /**
+     * Poll fast for a while, after the mode was changed here.
+     */
+    void boost();
+
+    /**
+     * Start over for another SmartEVSE: everything is due now.
+     */
+    void reset();
+
+    bool lcdDue();
+
+    bool settingsDue();
+
+    /**
+     * Report an LCD request.
+     *
+     * @param reachable False if the SmartEVSE did not answer.
+     * @param changed True if the frame differs from the previous one.
+     */
+    void lcdFetched(bool reachable, bool changed);
+
+    /**
+     * Report a /settings request.
+     *
+     * @param reachable False if the SmartEVSE did not answer.
+     * @param charging True if the SmartEVSE is charging a car.
+     */
+    void settingsFetched(bool reachable, bool charging);
+
+    PollPace getPace();
+
+    PollStats getStats() const;
+
+private:
+    hal::Clock &clock;
+    // PollRates in field order.
+    std::atomic<uint32_t> rates[6];
+
+    // Owned by the network task.
+    bool lcdPolled;
+    bool settingsPolled;
+    bool reachable;
+    bool charging;
+    uint32_t lastLcdPoll;
+    uint32_t lastSettingsPoll;
+    uint32_t lastChange;
+    uint32_t boostedUntil;
+    // Counted since windowStart, written by the network task only. getStats() reads them when the
+    // window ran out without a request closing it.
+    std::atomic<uint32_t> windowStart;
+    std::atomic<uint32_t> frames;
+    std::atomic<uint32_t> lcdRequests;
+    std::atomic<uint32_t> settingsRequests;
+
+    // The last window, in thousandths per second.
+    std::atomic<uint32_t> framesRate;
+    std::atomic<uint32_t> lcdRate;
+    std::atomic<uint32_t> settingsRate;
+    std::atomic<int> lastPace;
+
+    /**
+     * @param first The index of the fast rate of the request in rates.
+     */
+    uint32_t interval(size_t first);
+
+    /**
+     * Start a new window when the current one is over.
+     */
+    void updateStats();
+};
+
+/**
+ * Parse "lcdFast,lcdNormal,lcdIdle,settingsFast,settingsNormal,settingsIdle" in ms.
+ *
+ * @return False, leaving rates as they are, if the list is not 6 positive numbers.
+ */
+bool parsePollRates(const char *list, PollRates &rates);
+
+#endif // POLL_SCHEDULER_H
@@ -0,0 +1,70 @@
+#include "settings_cache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+
+// FNV-1a, enough to tell bodies apart for the ETag.
+constexpr uint32_t FNV_OFFSET_BASIS = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+
+SettingsCache::SettingsCache(hal::Clock &clock)
+    : clock(clock), buffers(), published(0), version(0), readers(), pinned(false), overflowed(false),
+      hash(FNV_OFFSET_BASIS) {
+}
+
+void SettingsCache::begin() {
+    // The buffer that is not published belongs to the network task, only it changes published.
+    // A reader may still be sending it from before the last commit(), then this body is not cached.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pinned = readers[1 - published] != 0;
+    }
+    if (pinned) {
+        return;
+    }
+    buffers[1 - published].length = 0;
+    overflowed = false;
+    hash = FNV_OFFSET_BASIS;
+}
+
+void SettingsCache::append(const uint8_t *data, const size_t length) {
+    Buffer &buffer = buffers[1 - published];
+    if (pinned || overflowed || buffer.length + length > sizeof(buffer.body)) {
+        overflowed = true;
+        return;
+    }
+    memcpy(buffer.body + buffer.length, data, length);
+    buffer.length += length;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+}
+
+void SettingsCache::commit() {
+    if (pinned) {
+        LOG_PRINTF("==== SettingsCache::commit() previous body still being sent, not cached\n");
+        return;
+    }
+    if (overflowed) {
+        LOG_PRINTF("==== SettingsCache::commit() body larger than %d bytes, not cached\n", SETTINGS_CACHE_SIZE);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    Buffer &buffer = buffers[1 - published];
+    snprintf(buffer.etag, sizeof(buffer.etag), "\"%08x\"", static_cast<unsigned>(hash));
+    buffer.fetchedAt = clock.millis();
+    published = 1 - published;
+    version++;
+}
+
+uint32_t SettingsCache::getVersion() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return version;
+}
+
+uint32_t SettingsCache::getAge() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return version == 0 ? UINT32_MAX : clock.millis() - buffers[published].fetchedAt;
+}
@@ -0,0 +1,123 @@
+#ifndef SETTINGS_CACHE_H
+#define SETTINGS_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "hal.h"
+
+// The largest /settings body that is cached.
+#define SETTINGS_CACHE_SIZE 8192
+// A quoted 32-bit hash.
+#define SETTINGS_ETAG_LEN 12
+
+/**
+ * The last /settings body the network task received, for the /api/evse/settings proxy.
+ *
+ * The network task captures a body while it parses it, and commits it when it was complete
+ * and valid. It writes into its own buffer, so readers only wait for the swap at commit(). A reader
+ * pins the published buffer and reads it without the lock; while it is still pinned after the next
+ * commit(), the network task skips capturing rather than overwrite it.
+ */
+class SettingsCache {
+public:
+    explicit SettingsCache(hal::Clock &clock);
+
+    // ---- Network task ----
+
+    /**
+     * Start capturing a new body, dropping an uncommitted one. Nothing is captured while a reader
+     * still has the buffer pinned.
+     */
+    void begin();
+
+    void append(const uint8_t *data, size_t length);
+
+    /**
+     * Publish the captured body, unless it did not fit.
+     */
+    void commit();
+
+    // ---- Any task ----
+
+    /**
+     * @return The number of bodies committed so far.
+     */
+    uint32_t getVersion() const;
+
+    /**
+     * @return Milliseconds since the last commit, UINT32_MAX if there is no body yet.
+     */
+    uint32_t getAge() const;
+
+    /**
+     * Call reader(body, length, etag, age) with the last body. The lock is only held to pin the
+     * buffer, so a slow reader never blocks commit().
+     *
+     * @return False if there is no body yet.
+     */
+    template<typename Reader>
+    bool read(Reader reader) const {
+        int index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (version == 0) {
+                return false;
+            }
+            index = published;
+            readers[index]++;
+        }
+        const Buffer &buffer = buffers[index];
+        reader(buffer.body, buffer.length, buffer.etag, clock.millis() - buffer.fetchedAt);
+        std::lock_guard<std::mutex> lock(mutex);
+        readers[index]--;
+        return true;
+    }
+
+private:
+    struct Buffer {
+        char body[SETTINGS_CACHE_SIZE];
+        size_t length;
+        char etag[SETTINGS_ETAG_LEN];
+        uint32_t fetchedAt;
+    };
+
+    hal::Clock &clock;
+    mutable std::mutex mutex;
+    Buffer buffers[2];
+    // Guarded by mutex.
+    int published;
+    uint32_t version;
+    // Readers per buffer.
+    mutable int readers[2];
+
+    // Owned by the network task.
+    // The buffer to capture into is still pinned by a reader.
+    bool pinned;
+    bool overflowed;
+    uint32_t hash;
+};
+
+/**
+ * A response body that copies every byte it reads into a SettingsCache.
+ */
+class TeeStream : public hal::ByteStream {
+public:
+    TeeStream(hal::ByteStream &source, SettingsCache &cache) : source(source), cache(cache) {
+    }
+
+    using hal::ByteStream::readBytes;
+
+    size_t readBytes(uint8_t *buffer, const size_t length) override {
+        const size_t received = source.readBytes(buffer, length);
+        cache.append(buffer, received);
+        return received;
+    }
+
+private:
+    hal::ByteStream &source;
+    SettingsCache &cache;
+};
+
+#endif // SETTINGS_CACHE_H
@@ -0,0 +1,165 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Lock-free single-producer/single-consumer ring of Capacity values, dropping the oldest when full.
+ *
+ * The producer fills beginWrite() and calls endWrite(); the consumer reads beginRead() and calls
+ * endRead(). Values are filled and read in place. Every slot has a sequence number that tells whose
+ * turn it is, as in Dmitry Vyukov's bounded queue. When the ring is full the producer takes the oldest
+ * value away from the consumer the same way the consumer takes it, so the two never touch a slot at
+ * the same time and the consumer always gets the freshest values.
+ */
+template<typename T, size_t Capacity>
+class SpscRing {
+public:
+    // So positions stay consistent when they wrap around.
+    static_assert(Capacity >= 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    SpscRing() : head(0), tail(0), reading(0), written(0), read(0), dropped(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    SpscRing(const SpscRing &) = delete;
+
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // ---- Producer ----
+
+    /**
+     * The slot to fill next. Drops the oldest value when the ring is full.
+     *
+     * @return nullptr in the rare case the consumer is still reading the slot, try again later.
+     */
+    T *beginWrite() {
+        const size_t position = head.load(std::memory_order_relaxed);
+        Slot &slot = slots[position % Capacity];
+        if (slot.sequence.load(std::memory_order_acquire) != position) {
+            dropOldest(position - Capacity);
+            if (slot.sequence.load(std::memory_order_acquire) != position) {
+                return nullptr;
+            }
+        }
+        return &slot.value;
+    }
+
+    /**
+     * Hand the slot of beginWrite() to the consumer.
+     */
+    void endWrite() {
+        const size_t position = head.load(std::memory_order_relaxed);
+        slots[position % Capacity].sequence.store(position + 1, std::memory_order_release);
+        head.store(position + 1, std::memory_order_release);
+        written.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // ---- Consumer ----
+
+    /**
+     * The oldest value, valid until endRead().
+     *
+     * @return nullptr when the ring is empty.
+     */
+    const T *beginRead() {
+        size_t position = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots[position % Capacity];
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                // Empty, or the producer just dropped this one: look again at the new tail.
+                const size_t current = tail.load(std::memory_order_relaxed);
+                if (current == position) {
+                    return nullptr;
+                }
+                position = current;
+                continue;
+            }
+            if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                reading = position;
+                return &slot.value;
+            }
+        }
+    }
+
+    /**
+     * Give the slot of beginRead() back to the producer.
+     */
+    void endRead() {
+        slots[reading % Capacity].sequence.store(reading + Capacity, std::memory_order_release);
+        read.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // ---- Any task ----
+
+    /**
+     * @return The values waiting for the consumer.
+     */
+    size_t size() const {
+        const size_t filled = head.load(std::memory_order_acquire);
+        const size_t taken = tail.load(std::memory_order_acquire);
+        // Read at different times, the tail may have passed the head that was read.
+        return filled - taken <= Capacity ? filled - taken : 0;
+    }
+
+    uint32_t getWritten() const {
+        return written.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getRead() const {
+        return read.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return The values the producer dropped, because the ring was full or the slot was being read.
+     */
+    uint32_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Count a value the producer did not write, because beginWrite() returned nullptr.
+     */
+    void countDropped() {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        // position when the producer may fill it, position + 1 when the consumer may read it.
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Slot slots[Capacity];
+    // Owned by the producer.
+    std::atomic<size_t> head;
+    // Moved by the consumer, and by the producer when it drops the oldest value.
+    std::atomic<size_t> tail;
+    // Owned by the consumer.
+    size_t reading;
+    std::atomic<uint32_t> written;
+    std::atomic<uint32_t> read;
+    std::atomic<uint32_t> dropped;
+
+    /**
+     * Take the oldest value like the consumer would, and give its slot back without reading it.
+     * Nothing happens when the consumer took it first.
+     *
+     * @param position The position of the value in the slot the producer needs.
+     */
+    void dropOldest(size_t position) {
+        Slot &slot = slots[position % Capacity];
+        if (slot.sequence.load(std::memory_order_acquire) == position + 1 &&
+            tail.compare_exchange_strong(position, position + 1, std::memory_order_relaxed)) {
+            slot.sequence.store(position + Capacity, std::memory_order_release);
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,64 @@
+#ifndef THROUGHPUT_COUNTER_H
+#define THROUGHPUT_COUNTER_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "hal.h"
+
+// The rate is counted over windows of this many ms.
+#define THROUGHPUT_WINDOW 10000
+
+/**
+ * Counts what a stage handled, in total and per second over the last window.
+ *
+ * count() runs on the task of the stage, the getters are safe from any task.
+ */
+class ThroughputCounter {
+public:
+    explicit ThroughputCounter(hal::Clock &clock) : clock(clock), total(0), rate(0), windowStart(0), windowCount(0) {
+    }
+
+    void count() {
+        total.fetch_add(1, std::memory_order_relaxed);
+        const uint32_t counted = windowCount.fetch_add(1, std::memory_order_relaxed) + 1;
+        const uint32_t now = clock.millis();
+        const uint32_t elapsed = now - windowStart.load(std::memory_order_relaxed);
+        if (elapsed >= THROUGHPUT_WINDOW) {
+            rate.store(thousandthsPerSecond(counted, elapsed), std::memory_order_relaxed);
+            windowCount.store(0, std::memory_order_relaxed);
+            windowStart.store(now, std::memory_order_release);
+        }
+    }
+
+    uint32_t getTotal() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * A window that ran out without count() closing it is counted up to now, so the rate of a stage
+     * that stopped drops to 0 instead of staying at its last value.
+     */
+    float getPerSecond() const {
+        const uint32_t elapsed = clock.millis() - windowStart.load(std::memory_order_acquire);
+        if (elapsed >= THROUGHPUT_WINDOW) {
+            return thousandthsPerSecond(windowCount.load(std::memory_order_relaxed), elapsed) / 1000.0f;
+        }
+        return rate.load(std::memory_order_relaxed) / 1000.0f;
+    }
+
+private:
+    hal::Clock &clock;
+    std::atomic<uint32_t> total;
+    // Thousandths per second.
+    std::atomic<uint32_t> rate;
+    // Written by count() only.
+    std::atomic<uint32_t> windowStart;
+    std::atomic<uint32_t> windowCount;
+
+    static uint32_t thousandthsPerSecond(const uint32_t count, const uint32_t elapsed) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(count) * 1000000 / elapsed);
+    }
+};
+
+#endif // THROUGHPUT_COUNTER_H
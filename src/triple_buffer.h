@@ -0,0 +1,76 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free single-producer/single-consumer handoff of the latest value.
+ *
+ * The producer fills back() and calls publish(); the consumer calls consume() and, when it
+ * returns true, reads front(). Each of the three slots is owned by exactly one side at any
+ * time, so neither side ever waits for the other and the consumer always sees the most
+ * recently published value. Intermediate values may be skipped.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle(1), backIndex(0), frontIndex(2) {
+    }
+
+    TripleBuffer(const TripleBuffer &) = delete;
+
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    /**
+     * The slot the producer writes into. Only valid on the producer side.
+     */
+    T &back() {
+        return slots[backIndex];
+    }
+
+    /**
+     * Hand the back slot to the consumer and take over the previous middle slot.
+     */
+    void publish() {
+        const uint32_t previous = middle.exchange(backIndex | FRESH_BIT, std::memory_order_acq_rel);
+        backIndex = previous & INDEX_MASK;
+    }
+
+    /**
+     * Take the most recently published value, if there is a new one.
+     *
+     * @return True when front() changed since the previous call.
+     */
+    bool consume() {
+        if ((middle.load(std::memory_order_acquire) & FRESH_BIT) == 0) {
+            return false;
+        }
+        const uint32_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    /**
+     * The last consumed value. Only valid on the consumer side.
+     */
+    const T &front() const {
+        return slots[frontIndex];
+    }
+
+private:
+    enum : uint32_t {
+        INDEX_MASK = 0x03,
+        FRESH_BIT = 0x04
+    };
+
+    T slots[3];
+    // Index of the middle slot, plus FRESH_BIT when it holds a value the consumer has not seen.
+    std::atomic<uint32_t> middle;
+    // Owned by the producer.
+    uint32_t backIndex;
+    // Owned by the consumer.
+    uint32_t frontIndex;
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,78 @@
+#include "widget.h"
+
+// The window pixelsPerSecond is counted over.
+constexpr uint32_t COMPOSITOR_RATE_WINDOW_MS = 1000;
+
+void Widget::bind(const uint32_t newValue) {
+    if (bound && newValue == value) {
+        return;
+    }
+    value = newValue;
+    bound = true;
+    renderNeeded = true;
+    pushNeeded = true;
+}
+
+void Widget::setVisible(const bool newVisible) {
+    if (newVisible && !visible) {
+        pushNeeded = true;
+    }
+    visible = newVisible;
+}
+
+bool Compositor::add(Widget &widget) {
+    if (widgetCount == COMPOSITOR_MAX_WIDGETS) {
+        return false;
+    }
+    widgets[widgetCount++] = &widget;
+    return true;
+}
+
+uint32_t Compositor::compose() {
+    uint32_t pixels = 0;
+    for (size_t i = 0; i < widgetCount; i++) {
+        Widget &widget = *widgets[i];
+        // Nothing to show before the first value.
+        if (!widget.visible || !widget.bound) {
+            continue;
+        }
+        if (widget.renderNeeded) {
+            widget.render(widget.value);
+            widget.renderNeeded = false;
+            widgetsRendered.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (widget.pushNeeded) {
+            widget.push();
+            widget.pushNeeded = false;
+            widgetsPushed.fetch_add(1, std::memory_order_relaxed);
+            pixels += static_cast<uint32_t>(widget.width * widget.height);
+        }
+    }
+    pixelsPushed.fetch_add(pixels, std::memory_order_relaxed);
+
+    windowPixels += pixels;
+    const uint32_t now = clock.millis();
+    const uint32_t elapsed = now - windowStart;
+    if (elapsed >= COMPOSITOR_RATE_WINDOW_MS) {
+        pixelsPerSecond.store(static_cast<uint32_t>(static_cast<uint64_t>(windowPixels) * 1000 / elapsed),
+                              std::memory_order_relaxed);
+        windowStart = now;
+        windowPixels = 0;
+    }
+    return pixels;
+}
+
+CompositorStats Compositor::getStats() const {
+    CompositorStats stats;
+    stats.widgetsRendered = widgetsRendered.load(std::memory_order_relaxed);
+    stats.widgetsPushed = widgetsPushed.load(std::memory_order_relaxed);
+    stats.pixelsPushed = pixelsPushed.load(std::memory_order_relaxed);
+    stats.pixelsPerSecond = pixelsPerSecond.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Compositor::invalidate() {
+    for (size_t i = 0; i < widgetCount; i++) {
+        widgets[i]->invalidate();
+    }
+}
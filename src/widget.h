@@ -0,0 +1,141 @@
+#ifndef WIDGET_H
+#define WIDGET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+
+// Widgets one compositor manages.
+#define COMPOSITOR_MAX_WIDGETS 8
+
+/**
+ * A rectangle of the UI, drawn off-screen for the value bound to it.
+ *
+ * It is only drawn again when another value is bound, and only pushed to the display when it
+ * was drawn again or something else was drawn over it. Runs on the task that holds the display.
+ */
+class Widget {
+public:
+    Widget(const int x, const int y, const int width, const int height)
+        : x(x), y(y), width(width), height(height), value(0), bound(false), visible(true), renderNeeded(false),
+          pushNeeded(false) {
+    }
+
+    virtual ~Widget() = default;
+
+    /**
+     * @param value What the widget shows, packed by the caller. A different value draws it again.
+     */
+    void bind(uint32_t value);
+
+    /**
+     * A hidden widget is not pushed, clearing its area is up to the caller.
+     */
+    void setVisible(bool visible);
+
+    /**
+     * The display was drawn over, push the widget again as it is.
+     */
+    void invalidate() {
+        pushNeeded = true;
+    }
+
+    bool isVisible() const {
+        return visible;
+    }
+
+    int getX() const {
+        return x;
+    }
+
+    int getY() const {
+        return y;
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+protected:
+    /**
+     * Draw the value off-screen.
+     */
+    virtual void render(uint32_t value) = 0;
+
+    /**
+     * Push what render() drew to the display, at getX(), getY().
+     */
+    virtual void push() = 0;
+
+private:
+    friend class Compositor;
+
+    const int x;
+    const int y;
+    const int width;
+    const int height;
+    uint32_t value;
+    bool bound;
+    bool visible;
+    bool renderNeeded;
+    bool pushNeeded;
+};
+
+struct CompositorStats {
+    uint32_t widgetsRendered;
+    uint32_t widgetsPushed;
+    uint32_t pixelsPushed;
+    // Over the last full second.
+    uint32_t pixelsPerSecond;
+};
+
+/**
+ * Draws and pushes the widgets that changed, leaves the others alone.
+ * Runs on the task that holds the display, except getStats().
+ */
+class Compositor {
+public:
+    explicit Compositor(hal::Clock &clock)
+        : clock(clock), widgets(), widgetCount(0), widgetsRendered(0), widgetsPushed(0), pixelsPushed(0),
+          pixelsPerSecond(0), windowStart(0), windowPixels(0) {
+    }
+
+    /**
+     * @return False when COMPOSITOR_MAX_WIDGETS are added already.
+     */
+    bool add(Widget &widget);
+
+    /**
+     * Draw the widgets that got another value and push them, with the ones that were drawn over.
+     * Call it often, also when nothing changed, to keep pixelsPerSecond current.
+     *
+     * @return The pixels pushed.
+     */
+    uint32_t compose();
+
+    /**
+     * The whole display was drawn over, push all widgets again.
+     */
+    void invalidate();
+
+    CompositorStats getStats() const;
+
+private:
+    hal::Clock &clock;
+    Widget *widgets[COMPOSITOR_MAX_WIDGETS];
+    size_t widgetCount;
+    std::atomic<uint32_t> widgetsRendered;
+    std::atomic<uint32_t> widgetsPushed;
+    std::atomic<uint32_t> pixelsPushed;
+    std::atomic<uint32_t> pixelsPerSecond;
+    uint32_t windowStart;
+    uint32_t windowPixels;
+};
+
+#endif // WIDGET_H
@@ -0,0 +1,249 @@
+#ifndef FAKES_H
+#define FAKES_H
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hal.h"
+
+/**
+ * Fakes of the hal interfaces, for the native tests.
+ */
+
+class FakeClock : public hal::Clock {
+public:
+    uint32_t now = 1;
+
+    uint32_t millis() override {
+        return now;
+    }
+
+    uint32_t micros() override {
+        return now * 1000;
+    }
+
+    void delay(const uint32_t ms) override {
+        now += ms;
+    }
+};
+
+/**
+ * Records the pixels pushed to it in a frame buffer. DMA transfers land there at waitDma().
+ */
+class FakeDisplay : public hal::Display {
+public:
+    static const int WIDTH = 320;
+    static const int HEIGHT = 240;
+
+    uint16_t pixels[HEIGHT][WIDTH] = {};
+    uint32_t pixelsPushed = 0;
+    uint32_t windows = 0;
+    int writeDepth = 0;
+    uint32_t dmaTransfers = 0;
+    // Pixels of a DMA transfer that changed, or a window that moved, before waitDma().
+    uint32_t dmaViolations = 0;
+
+    int width() override {
+        return WIDTH;
+    }
+
+    int height() override {
+        return HEIGHT;
+    }
+
+    void startWrite() override {
+        writeDepth++;
+    }
+
+    void endWrite() override {
+        writeDepth--;
+    }
+
+    void setAddrWindow(const int x, const int y, const int w, const int h) override {
+        if (dmaPixels != nullptr) {
+            dmaViolations++;
+        }
+        windowX = x;
+        windowY = y;
+        windowWidth = w;
+        windowHeight = h;
+        cursor = 0;
+        windows++;
+    }
+
+    void pushPixels(const uint16_t *data, const uint32_t count) override {
+        for (uint32_t i = 0; i < count; i++, cursor++) {
+            const int x = windowX + static_cast<int>(cursor % windowWidth);
+            const int y = windowY + static_cast<int>(cursor / windowWidth);
+            if (x < WIDTH && y < HEIGHT && y < windowY + windowHeight) {
+                pixels[y][x] = data[i];
+            }
+        }
+        pixelsPushed += count;
+    }
+
+    void pushPixelsDma(const uint16_t *data, const uint32_t count) override {
+        // Like LovyanGFX, the next transfer waits for the previous one.
+        waitDma();
+        dmaPixels = data;
+        dmaCopy.assign(data, data + count);
+        dmaTransfers++;
+    }
+
+    void waitDma() override {
+        if (dmaPixels == nullptr) {
+            return;
+        }
+        if (memcmp(dmaPixels, dmaCopy.data(), dmaCopy.size() * sizeof(uint16_t)) != 0) {
+            dmaViolations++;
+        }
+        dmaPixels = nullptr;
+        pushPixels(dmaCopy.data(), static_cast<uint32_t>(dmaCopy.size()));
+    }
+
+private:
+    int windowX = 0;
+    int windowY = 0;
+    int windowWidth = 1;
+    int windowHeight = 0;
+    uint32_t cursor = 0;
+    const uint16_t *dmaPixels = nullptr;
+    std::vector<uint16_t> dmaCopy;
+};
+
+/**
+ * A body read from memory, handing out at most maxRead bytes per call to exercise short reads.
+ */
+class MemoryStream : public hal::ByteStream {
+public:
+    std::string data;
+    size_t position = 0;
+    size_t maxRead = 7;
+
+    using hal::ByteStream::readBytes;
+
+    size_t readBytes(uint8_t *buffer, const size_t length) override {
+        size_t count = 0;
+        while (count < length && position < data.size()) {
+            const size_t n = std::min(std::min(length - count, maxRead), data.size() - position);
+            memcpy(buffer + count, data.data() + position, n);
+            count += n;
+            position += n;
+        }
+        return count;
+    }
+};
+
+/**
+ * Answers requests from a table of canned responses, by URL.
+ */
+class FakeHttpClient : public hal::HttpClient {
+public:
+    struct Response {
+        int status;
+        std::string body;
+    };
+
+    std::map<std::string, Response> responses;
+    std::vector<std::string> requests;
+    int ended = 0;
+    // Hosts that accept connections, by URL prefix "http://host[:port]". Empty: all of them.
+    std::vector<std::string> reachable;
+    int probes = 0;
+
+    int get(const char *url, uint32_t) override {
+        return respond("GET ", url);
+    }
+
+    int post(const char *url, uint32_t) override {
+        return respond("POST ", url);
+    }
+
+    bool probe(const char *url, uint32_t) override {
+        probes++;
+        if (reachable.empty()) {
+            return true;
+        }
+        for (const std::string &prefix: reachable) {
+            if (strncmp(url, prefix.c_str(), prefix.size()) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    hal::ByteStream &body() override {
+        return responseBody;
+    }
+
+    void end() override {
+        ended++;
+    }
+
+    hal::HttpStats getStats() const override {
+        return {1, static_cast<uint32_t>(requests.size())};
+    }
+
+private:
+    MemoryStream responseBody;
+
+    int respond(const char *method, const char *url) {
+        requests.push_back(std::string(method) + url);
+        const auto it = responses.find(url);
+        if (it == responses.end()) {
+            // HTTPC_ERROR_CONNECTION_REFUSED
+            return -1;
+        }
+        responseBody.data = it->second.body;
+        responseBody.position = 0;
+        return it->second.status;
+    }
+};
+
+class FakeDiscovery : public hal::Discovery {
+public:
+    std::vector<hal::DiscoveredHost> hosts;
+    int browses = 0;
+
+    size_t browse(const char *, const char *, hal::DiscoveredHost *found, const size_t maxHosts, uint32_t) override {
+        browses++;
+        size_t count = 0;
+        for (; count < hosts.size() && count < maxHosts; count++) {
+            found[count] = hosts[count];
+        }
+        return count;
+    }
+
+    // Host name to address, hosts not in here do not answer.
+    std::map<std::string, std::string> addresses;
+    std::vector<std::string> resolved;
+
+    bool resolve(const char *host, char *ip, const size_t ipLength) override {
+        resolved.push_back(host);
+        if (!addresses.count(host)) {
+            return false;
+        }
+        snprintf(ip, ipLength, "%s", addresses[host].c_str());
+        return true;
+    }
+};
+
+class FakeStorage : public hal::Storage {
+public:
+    std::map<std::string, std::string> values;
+
+    size_t getString(const char *key, char *value, const size_t maxLength) override {
+        const std::string stored = values.count(key) ? values[key] : "";
+        snprintf(value, maxLength, "%s", stored.c_str());
+        return stored.size();
+    }
+
+    bool putString(const char *key, const char *value) override {
+        values[key] = value;
+        return true;
+    }
+};
+
+#endif // FAKES_H
@@ -0,0 +1,1014 @@
+#include <unity.h>
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "bmp_decoder.h"
+#include "circuit_breaker.h"
+#include "event_stream.h"
+#include "evse_client.h"
+#include "evse_fleet.h"
+#include "evse_poller.h"
+#include "fakes.h"
+#include "http_chunked.h"
+#include "json_arena.h"
+#include "latency_histogram.h"
+#include "lcd_mirror.h"
+#include "lcd_stream.h"
+#include "mdns_browser.h"
+#include "metrics.h"
+#include "mono_blitter.h"
+#include "poll_scheduler.h"
+#include "settings_cache.h"
+#include "spsc_ring.h"
+#include "throughput_counter.h"
+#include "triple_buffer.h"
+#include "widget.h"
+
+// ---- Helpers ----
+
+static void appendLe16(std::string &data, const uint16_t value) {
+    data += static_cast<char>(value & 0xff);
+    data += static_cast<char>(value >> 8);
+}
+
+static void appendLe32(std::string &data, const uint32_t value) {
+    appendLe16(data, static_cast<uint16_t>(value & 0xffff));
+    appendLe16(data, static_cast<uint16_t>(value >> 16));
+}
+
+/**
+ * Build a 1 bit per pixel BMP like the SmartEVSE /lcd endpoint returns.
+ * Every byte of row y (counted from the top) is rowValue(y).
+ */
+static std::string makeBmp(const int width, const int height, uint8_t (*rowValue)(int), const bool topDown = false,
+                           const bool whiteFirst = false) {
+    const uint32_t stride = (width + 31) / 32 * 4;
+    std::string bmp = "BM";
+    appendLe32(bmp, 62 + stride * height);
+    appendLe32(bmp, 0);
+    appendLe32(bmp, 62);
+    appendLe32(bmp, 40);
+    appendLe32(bmp, width);
+    appendLe32(bmp, topDown ? -height : height);
+    appendLe16(bmp, 1);
+    appendLe16(bmp, 1);
+    appendLe32(bmp, 0);
+    appendLe32(bmp, stride * height);
+    appendLe32(bmp, 0);
+    appendLe32(bmp, 0);
+    appendLe32(bmp, 2);
+    appendLe32(bmp, 0);
+    appendLe32(bmp, whiteFirst ? 0x00ffffff : 0);
+    appendLe32(bmp, whiteFirst ? 0 : 0x00ffffff);
+    for (int i = 0; i < height; i++) {
+        const int y = topDown ? i : height - 1 - i;
+        for (uint32_t col = 0; col < stride; col++) {
+            bmp += static_cast<char>(rowValue(y));
+        }
+    }
+    return bmp;
+}
+
+static std::string chunked(const std::string &body) {
+    char sizeLine[16];
+    snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", body.size());
+    return sizeLine + body + "\r\n0\r\n\r\n";
+}
+
+static uint8_t rowNumber(const int y) {
+    return static_cast<uint8_t>(y);
+}
+
+static uint8_t leftPixelOnly(const int) {
+    return 0x80;
+}
+
+static EvseTarget target(const char *host, const char *ip = "") {
+    EvseTarget target = {};
+    copyString(target.host, host);
+    copyString(target.ip, ip);
+    target.port = 80;
+    return target;
+}
+
+static hal::DiscoveredHost discoveredHost(const char *host, const char *ip) {
+    hal::DiscoveredHost found = {};
+    copyString(found.host, host);
+    copyString(found.ip, ip);
+    found.port = 80;
+    return found;
+}
+
+// What the event stream wrote to each socket, failingSocket fails.
+static std::map<int, std::string> socketOutput;
+static int failingSocket = -1;
+
+static int sendToSocket(const int fd, const char *data, const size_t length) {
+    if (fd == failingSocket) {
+        return -1;
+    }
+    socketOutput[fd].append(data, length);
+    return static_cast<int>(length);
+}
+
+static const char *SETTINGS_JSON =
+        R"({"mode":"Smart","mode_id":3,"evse":{"state":"Charging","temp":30},)"
+        R"("settings":{"charge_current":160,"solar_start_current":4},"phase_currents":{"TOTAL":123,"L1":41},)"
+        R"("schedule":[{"start":"00:00","stop":"06:00","days":[1,2,3,4,5],"current":{"min":6,"max":16}}]})";
+
+// ---- Tests ----
+
+void test_triple_buffer_hands_over_latest_value(void) {
+    TripleBuffer<int> buffer;
+    TEST_ASSERT_FALSE(buffer.consume());
+
+    buffer.back() = 1;
+    buffer.publish();
+    buffer.back() = 2;
+    buffer.publish();
+    TEST_ASSERT_TRUE(buffer.consume());
+    TEST_ASSERT_EQUAL(2, buffer.front());
+    TEST_ASSERT_FALSE(buffer.consume());
+    TEST_ASSERT_EQUAL(2, buffer.front());
+}
+
+void test_spsc_ring_drops_oldest_and_counts_stages(void) {
+    SpscRing<int, 2> ring;
+    TEST_ASSERT_NULL(ring.beginRead());
+
+    for (int i = 1; i <= 3; i++) {
+        *ring.beginWrite() = i;
+        ring.endWrite();
+    }
+    // Full after 2, the third dropped the oldest.
+    TEST_ASSERT_EQUAL(2, ring.size());
+    TEST_ASSERT_EQUAL(1, ring.getDropped());
+    const int *value = ring.beginRead();
+    TEST_ASSERT_EQUAL(2, *value);
+    // The slot being read is not taken away, the producer tries again later.
+    TEST_ASSERT_NULL(ring.beginWrite());
+    ring.endRead();
+    *ring.beginWrite() = 4;
+    ring.endWrite();
+    TEST_ASSERT_EQUAL(3, *ring.beginRead());
+    ring.endRead();
+    TEST_ASSERT_EQUAL(4, *ring.beginRead());
+    ring.endRead();
+    TEST_ASSERT_NULL(ring.beginRead());
+    TEST_ASSERT_EQUAL(4, ring.getWritten());
+    TEST_ASSERT_EQUAL(3, ring.getRead());
+    TEST_ASSERT_EQUAL(0, ring.size());
+
+    FakeClock clock;
+    ThroughputCounter counter(clock);
+    for (int i = 0; i < 25; i++) {
+        clock.delay(400);
+        counter.count();
+    }
+    TEST_ASSERT_EQUAL(25, counter.getTotal());
+    // 25 in the 10001 ms since the clock started.
+    TEST_ASSERT_EQUAL_FLOAT(2.499f, counter.getPerSecond());
+    // A stage that stopped drops to 0 once a window passed without counting.
+    clock.delay(20000);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, counter.getPerSecond());
+}
+
+void test_bmp_decoder_reads_chunked_bottom_up_bitmap(void) {
+    MemoryStream stream;
+    stream.data = chunked(makeBmp(LCD_WIDTH, LCD_HEIGHT, rowNumber));
+    ChunkedReader<MemoryStream> body(stream);
+
+    BmpInfo info;
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpHeader(body, info));
+    TEST_ASSERT_EQUAL(128, info.width);
+    TEST_ASSERT_EQUAL(64, info.height);
+    TEST_ASSERT_FALSE(info.topDown);
+
+    int rows[LCD_HEIGHT] = {};
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpRows(body, info, [&rows](const int y, const uint8_t *row) {
+        rows[y] = row[0];
+    }));
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        TEST_ASSERT_EQUAL(y, rows[y]);
+    }
+
+    // Reading past the body consumes the last chunk and the trailer, but nothing after it.
+    stream.data += "HTTP/1.1 200 OK";
+    uint8_t c;
+    TEST_ASSERT_EQUAL(0, body.readBytes(&c, 1));
+    TEST_ASSERT_TRUE(body.atEnd());
+    TEST_ASSERT_EQUAL(stream.data.size() - 15, stream.position);
+}
+
+void test_bmp_decoder_normalizes_top_down_rows_whatever_the_palette(void) {
+    MemoryStream stream;
+    stream.data = makeBmp(20, 3, rowNumber, true, true);
+
+    BmpInfo info;
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpHeader(stream, info));
+    TEST_ASSERT_TRUE(info.topDown);
+    TEST_ASSERT_EQUAL(4, info.rowStride);
+
+    int rows[3] = {};
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpRows(stream, info, [&rows](const int y, const uint8_t *row) {
+        rows[y] = row[0];
+    }));
+    TEST_ASSERT_EQUAL(0, rows[0]);
+    TEST_ASSERT_EQUAL(2, rows[2]);
+}
+
+void test_bmp_decoder_keeps_set_bits_lit_in_smartevse_bitmap(void) {
+    // Palette entry 0 is white and 1 is red, the set bits are the text.
+    FILE *file = fopen("src/smartevse.bmp", "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    MemoryStream stream;
+    char buffer[256];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        stream.data.append(buffer, length);
+    }
+    fclose(file);
+
+    BmpInfo info;
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpHeader(stream, info));
+    int lit = 0;
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpRows(stream, info, [&lit](int, const uint8_t *row) {
+        for (int col = 0; col < LCD_BYTES_PER_ROW; col++) {
+            lit += __builtin_popcount(row[col]);
+        }
+    }));
+    TEST_ASSERT_EQUAL(849, lit);
+}
+
+void test_bmp_decoder_rejects_truncated_and_foreign_data(void) {
+    MemoryStream stream;
+    stream.data = "GIF89a....................";
+    BmpInfo info;
+    TEST_ASSERT_EQUAL(BMP_NOT_A_BITMAP, readBmpHeader(stream, info));
+
+    stream.data = makeBmp(LCD_WIDTH, LCD_HEIGHT, rowNumber).substr(0, 500);
+    stream.position = 0;
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpHeader(stream, info));
+    TEST_ASSERT_EQUAL(BMP_SHORT_READ, readBmpRows(stream, info, [](int, const uint8_t *) {
+    }));
+
+    // A height of INT32_MIN cannot be flipped to a positive row count.
+    stream.data = makeBmp(8, 1, rowNumber);
+    stream.data.replace(22, 4, std::string("\x00\x00\x00\x80", 4));
+    stream.position = 0;
+    TEST_ASSERT_EQUAL(BMP_UNSUPPORTED, readBmpHeader(stream, info));
+}
+
+void test_evse_client_parses_settings(void) {
+    FakeHttpClient http;
+    http.responses["http://SmartEVSE-1.local/settings"] = {200, SETTINGS_JSON};
+    EvseClient client(http);
+    EvseSnapshot state = {false, EVSE_MODE_SOLAR, "", 0, 0, EVSE_ERROR_TIMEOUT, BREAKER_CLOSED};
+
+    client.fetchSettings(state, target("SmartEVSE-1"));
+
+    TEST_ASSERT_TRUE(state.connected);
+    TEST_ASSERT_EQUAL(EVSE_MODE_SMART, state.mode);
+    TEST_ASSERT_EQUAL_STRING("Charging", state.evseState);
+    TEST_ASSERT_EQUAL(160, state.chargeCurrent);
+    TEST_ASSERT_EQUAL(123, state.gridCurrent);
+    TEST_ASSERT_EQUAL(EVSE_ERROR_NONE, state.error);
+    TEST_ASSERT_EQUAL(1, http.ended);
+}
+
+void test_evse_client_reports_unreachable_host(void) {
+    FakeHttpClient http;
+    EvseClient client(http);
+    EvseSnapshot state = {true, EVSE_MODE_SOLAR, "", 0, 0, EVSE_ERROR_NONE, BREAKER_CLOSED};
+
+    TEST_ASSERT_FALSE(client.fetchSettings(state, target("SmartEVSE-1")));
+    TEST_ASSERT_FALSE(state.connected);
+    TEST_ASSERT_EQUAL(EVSE_ERROR_TIMEOUT, state.error);
+
+    client.fetchSettings(state, target(""));
+    TEST_ASSERT_EQUAL(EVSE_ERROR_NO_HOST, state.error);
+}
+
+void test_evse_client_fetches_lcd(void) {
+    FakeHttpClient http;
+    http.responses["http://SmartEVSE-1.local/lcd"] = {200, makeBmp(LCD_WIDTH, LCD_HEIGHT, rowNumber)};
+    EvseClient client(http);
+    LcdBody body;
+    LcdFrame frame = {};
+
+    TEST_ASSERT_TRUE(client.fetchLcd(body, target("SmartEVSE-1")));
+    TEST_ASSERT_TRUE(client.decodeLcd(body, frame));
+    TEST_ASSERT_TRUE(frame.valid);
+    TEST_ASSERT_EQUAL(0, frame.pixels[0][0]);
+    TEST_ASSERT_EQUAL(63, frame.pixels[63][15]);
+
+    http.responses.clear();
+    TEST_ASSERT_FALSE(client.fetchLcd(body, target("SmartEVSE-1")));
+    TEST_ASSERT_FALSE(client.decodeLcd(body, frame));
+    TEST_ASSERT_FALSE(frame.valid);
+}
+
+void test_json_arena_reuses_buffer_and_interns_states(void) {
+    JsonArena<64> arena;
+    void *first = arena.allocate(10);
+    void *second = arena.allocate(10);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_EQUAL(16 + 8, static_cast<uint8_t *>(second) - static_cast<uint8_t *>(first));
+    // The last block grows in place, freeing it gives the space back.
+    TEST_ASSERT_EQUAL_PTR(second, arena.reallocate(second, 20));
+    arena.deallocate(second);
+    TEST_ASSERT_EQUAL_PTR(second, arena.allocate(4));
+    // Too big for what is left: on the heap.
+    void *onHeap = arena.allocate(40);
+    TEST_ASSERT_EQUAL(1, arena.getFallbacks());
+    arena.deallocate(onHeap);
+    // All freed: the buffer starts over.
+    arena.deallocate(second);
+    arena.deallocate(first);
+    TEST_ASSERT_EQUAL_PTR(first, arena.allocate(40));
+
+    // Known states are the same pointer, others are copied once.
+    char state[] = "Charging";
+    TEST_ASSERT_EQUAL_PTR(internEvseState("Charging"), internEvseState(state));
+    copyString(state, "Boost");
+    const char *boost = internEvseState(state);
+    TEST_ASSERT_NOT_EQUAL(state, boost);
+    TEST_ASSERT_EQUAL_PTR(boost, internEvseState("Boost"));
+    TEST_ASSERT_EQUAL_STRING("", internEvseState(nullptr));
+    TEST_ASSERT_EQUAL(EVSE_MODE_UNKNOWN, modeFromId(7));
+    TEST_ASSERT_EQUAL_STRING("Smart", modeName(modeFromId(3)));
+    TEST_ASSERT_EQUAL_STRING("SmartEVSE Timeout", errorMessage(EVSE_ERROR_TIMEOUT));
+}
+
+void test_lcd_mirror_draws_doubled_frame_and_skips_unchanged_rows(void) {
+    FakeDisplay display;
+    LcdMirror mirror(display, 32, 0, MonoBlitter<2, BIT_ORDER_MSB_FIRST, 0xffff, 0x0000>::rowBlitter());
+    LcdFrame frame = {};
+    frame.valid = true;
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        frame.pixels[y][0] = leftPixelOnly(y);
+    }
+
+    mirror.draw(frame);
+    TEST_ASSERT_EQUAL(LCD_WIDTH * LCD_HEIGHT * 4, display.pixelsPushed);
+    TEST_ASSERT_EQUAL(0xffff, display.pixels[0][32]);
+    TEST_ASSERT_EQUAL(0xffff, display.pixels[1][33]);
+    TEST_ASSERT_EQUAL(0x0000, display.pixels[0][34]);
+    TEST_ASSERT_EQUAL(0, display.writeDepth);
+    // In strips of 8 doubled rows, each one left alone until it was sent.
+    TEST_ASSERT_EQUAL(LCD_WIDTH * LCD_HEIGHT * 4 / LCD_MIRROR_STRIP_PIXELS, display.dmaTransfers);
+    TEST_ASSERT_EQUAL(0, display.dmaViolations);
+
+    // Same frame, nothing is pushed.
+    display.pixelsPushed = 0;
+    mirror.draw(frame);
+    TEST_ASSERT_EQUAL(0, display.pixelsPushed);
+    TEST_ASSERT_EQUAL(LCD_HEIGHT, mirror.getStats().rowsSkipped);
+
+    // Only the changed row is pushed.
+    frame.pixels[10][3] = 0xff;
+    mirror.draw(frame);
+    TEST_ASSERT_EQUAL(LCD_WIDTH * 4, display.pixelsPushed);
+    TEST_ASSERT_EQUAL(0xffff, display.pixels[21][32 + 3 * 16]);
+    TEST_ASSERT_EQUAL(LCD_HEIGHT + 1, mirror.getStats().rowsDrawn);
+    TEST_ASSERT_EQUAL(0, display.dmaViolations);
+
+    // Pushed without DMA, the same pixels, and the wait is measured.
+    FakeDisplay syncDisplay;
+    FakeClock clock;
+    Metrics metrics(clock);
+    LcdMirror syncMirror(syncDisplay, 32, 0, MonoBlitter<2, BIT_ORDER_MSB_FIRST, 0xffff, 0x0000>::rowBlitter(),
+                         LCD_PUSH_SYNC, &metrics);
+    syncMirror.draw(frame);
+    TEST_ASSERT_EQUAL(0, syncDisplay.dmaTransfers);
+    TEST_ASSERT_EQUAL(0, memcmp(display.pixels, syncDisplay.pixels, sizeof(display.pixels)));
+    TEST_ASSERT_EQUAL(1, metrics.histogram(STAGE_LCD_SPI_WAIT).getSummary().count);
+}
+
+/**
+ * Counts how often it is drawn and pushed.
+ */
+class FakeWidget : public Widget {
+public:
+    FakeWidget(const int x, const int y, const int width, const int height) : Widget(x, y, width, height) {
+    }
+
+    uint32_t rendered = 0;
+    uint32_t lastValue = 0;
+    uint32_t pushed = 0;
+
+protected:
+    void render(const uint32_t value) override {
+        rendered++;
+        lastValue = value;
+    }
+
+    void push() override {
+        pushed++;
+    }
+};
+
+void test_compositor_pushes_only_changed_widgets(void) {
+    FakeClock clock;
+    Compositor compositor(clock);
+    FakeWidget dot(0, 204, 10, 20);
+    FakeWidget button(16, 128, 128, 56);
+    TEST_ASSERT_TRUE(compositor.add(dot));
+    TEST_ASSERT_TRUE(compositor.add(button));
+
+    // Nothing is drawn before a value is bound.
+    TEST_ASSERT_EQUAL(0, compositor.compose());
+    dot.bind(1);
+    button.bind(1);
+    TEST_ASSERT_EQUAL(200 + 7168, compositor.compose());
+
+    // The same value again is not drawn nor pushed.
+    dot.bind(1);
+    button.bind(1);
+    TEST_ASSERT_EQUAL(0, compositor.compose());
+    button.bind(3);
+    TEST_ASSERT_EQUAL(7168, compositor.compose());
+    TEST_ASSERT_EQUAL(1, dot.rendered);
+    TEST_ASSERT_EQUAL(2, button.rendered);
+    TEST_ASSERT_EQUAL(3, button.lastValue);
+
+    // Drawn over: pushed again as it is. Hidden: not pushed until shown.
+    compositor.invalidate();
+    button.setVisible(false);
+    TEST_ASSERT_EQUAL(200, compositor.compose());
+    button.setVisible(true);
+    TEST_ASSERT_EQUAL(7168, compositor.compose());
+    TEST_ASSERT_EQUAL(1, dot.rendered);
+    TEST_ASSERT_EQUAL(2, button.rendered);
+    TEST_ASSERT_EQUAL(3, button.pushed);
+
+    // Counted per second.
+    clock.delay(1000);
+    compositor.compose();
+    const CompositorStats stats = compositor.getStats();
+    TEST_ASSERT_EQUAL(3, stats.widgetsRendered);
+    TEST_ASSERT_EQUAL(5, stats.widgetsPushed);
+    TEST_ASSERT_EQUAL(400 + 3 * 7168, stats.pixelsPushed);
+    // The clock started at 1 ms.
+    TEST_ASSERT_EQUAL((400 + 3 * 7168) * 1000 / 1001, stats.pixelsPerSecond);
+}
+
+void test_mono_blitter_expands_bits_in_order_and_scale(void) {
+    const uint8_t row[2] = {0xa0, 0x01};
+    uint16_t out[16 * 3];
+
+    MonoBlitter<1, BIT_ORDER_MSB_FIRST, 7, 0>::expandRow(row, 16, out);
+    const uint16_t msbFirst[16] = {7, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7};
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(msbFirst, out, 16);
+
+    MonoBlitter<1, BIT_ORDER_LSB_FIRST, 7, 0>::expandRow(row, 16, out);
+    const uint16_t lsbFirst[16] = {0, 0, 0, 0, 0, 7, 0, 7, 7, 0, 0, 0, 0, 0, 0, 0};
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(lsbFirst, out, 16);
+
+    MonoBlitter<3, BIT_ORDER_MSB_FIRST, 7, 0>::expandRow(row, 16, out);
+    for (int i = 0; i < 16 * 3; i++) {
+        TEST_ASSERT_EQUAL(msbFirst[i / 3], out[i]);
+    }
+}
+
+void test_poller_publishes_state_and_changes_mode(void) {
+    FakeHttpClient http;
+    http.responses["http://SmartEVSE-1.local/settings"] = {200, SETTINGS_JSON};
+    http.responses["http://SmartEVSE-1.local/lcd"] = {200, makeBmp(LCD_WIDTH, LCD_HEIGHT, rowNumber)};
+    http.responses["http://SmartEVSE-1.local/settings?mode=2&override_current=0&starttime=2025-05-15T00:27"
+        "&stoptime=2025-05-15T00:27&repeat=0"] = {200, R"({"mode":"2"})"};
+    FakeClock clock;
+    FakeDiscovery discovery;
+    EvseClient client(http);
+    EvsePoller poller(client, clock, discovery);
+
+    poller.setTarget(target("SmartEVSE-1"));
+    poller.poll();
+    TEST_ASSERT_TRUE(poller.consumeSnapshot());
+    TEST_ASSERT_TRUE(poller.snapshot().connected);
+    TEST_ASSERT_FALSE(poller.consumeFrame());
+    TEST_ASSERT_EQUAL(1, poller.decode());
+    TEST_ASSERT_TRUE(poller.consumeFrame());
+    TEST_ASSERT_TRUE(poller.frame().valid);
+
+    // Nothing is due yet.
+    http.requests.clear();
+    poller.poll();
+    TEST_ASSERT_EQUAL(0, http.requests.size());
+    TEST_ASSERT_FALSE(poller.consumeSnapshot());
+
+    poller.requestModeChange(EVSE_MODE_SOLAR);
+    poller.poll();
+    TEST_ASSERT_EQUAL(1, http.requests.size());
+    TEST_ASSERT_TRUE(poller.consumeSnapshot());
+    TEST_ASSERT_EQUAL(EVSE_MODE_SOLAR, poller.snapshot().mode);
+
+    // The mode change speeds up polling, both are due again after a second.
+    clock.delay(1000);
+    poller.poll();
+    poller.decode();
+    TEST_ASSERT_TRUE(poller.consumeFrame());
+    TEST_ASSERT_TRUE(poller.consumeSnapshot());
+}
+
+void test_latency_histogram_counts_buckets_and_percentiles(void) {
+    LatencyHistogram histogram;
+    TEST_ASSERT_EQUAL(0, histogram.getSummary().percentile(0.5f));
+
+    // A stage of microseconds, 8 fast touches, one slow and one that took forever.
+    histogram.record(40);
+    for (int i = 0; i < 8; i++) {
+        histogram.record(800);
+    }
+    histogram.record(45000);
+    histogram.record(3000000);
+
+    const LatencySummary summary = histogram.getSummary();
+    TEST_ASSERT_EQUAL(11, summary.count);
+    TEST_ASSERT_EQUAL(40 + 8 * 800 + 45000 + 3000000, summary.sum);
+    TEST_ASSERT_EQUAL(3000000, summary.max);
+    // Up to 50 µs.
+    TEST_ASSERT_EQUAL(1, summary.buckets[0]);
+    // Up to 1 ms.
+    TEST_ASSERT_EQUAL(8, summary.buckets[4]);
+    // Up to 50 ms.
+    TEST_ASSERT_EQUAL(1, summary.buckets[9]);
+    TEST_ASSERT_EQUAL(1, summary.buckets[LATENCY_HISTOGRAM_BUCKETS - 1]);
+
+    // A bound is the bucket's upper bound, but never above the slowest sample.
+    TEST_ASSERT_EQUAL(1000, summary.percentile(0.5f));
+    TEST_ASSERT_EQUAL(50000, summary.percentile(0.9f));
+    TEST_ASSERT_EQUAL(3000000, summary.percentile(0.99f));
+
+    // The sum does not wrap at 2^32 µs, 71 minutes.
+    for (int i = 0; i < 1500; i++) {
+        histogram.record(3000000);
+    }
+    TEST_ASSERT_TRUE(histogram.getSummary().sum == 40 + 8 * 800 + 45000 + 1501ull * 3000000);
+}
+
+static void appendText(void *context, const char *text, const size_t length) {
+    static_cast<std::string *>(context)->append(text, length);
+}
+
+void test_metrics_time_stages_and_export_prometheus_text(void) {
+    FakeClock clock;
+    Metrics metrics(clock);
+    FakeHttpClient http;
+    http.responses["http://192.168.1.20:80/settings"] = {500, ""};
+    EvseClient client(http, nullptr, &metrics);
+    const EvseTarget target = {"SmartEVSE-1234", "192.168.1.20", 80};
+    EvseSnapshot state = {};
+
+    client.fetchSettings(state, target);
+    client.fetchSettings(state, target);
+    LcdBody body;
+    client.fetchLcd(body, target);
+    {
+        StageTimer timer(&metrics, STAGE_DRAW_STATUS);
+        clock.delay(3);
+    }
+
+    std::string text;
+    metrics.writePrometheus({100000, 80000, 60000, 0, 2}, {}, appendText, &text);
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("# TYPE smartevse_display_stage_seconds histogram\n"));
+    // 3 ms is in the 5 ms bucket, and all those above it.
+    const std::string drawStatus = "smartevse_display_stage_seconds_bucket{stage=\"draw_status\",";
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find(drawStatus + "le=\"0.002000\"} 0\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find(drawStatus + "le=\"0.005000\"} 1\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find(drawStatus + "le=\"+Inf\"} 1\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos,
+                          text.find("smartevse_display_stage_seconds_sum{stage=\"draw_status\"} 0.003000\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("smartevse_display_stage_seconds_count{stage=\"loop\"} 0\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("smartevse_display_http_responses_total{code=\"500\"} 2\n"));
+    // No response for /lcd: the fake refuses the connection.
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("smartevse_display_http_responses_total{code=\"-1\"} 1\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("smartevse_display_heap_min_free_bytes 80000\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("smartevse_display_heap_largest_free_block_bytes 60000\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, text.find("smartevse_display_json_arena_fallbacks_total 2\n"));
+}
+
+void test_circuit_breaker_backs_off_and_probes_before_retrying(void) {
+    FakeClock clock;
+    CircuitBreaker breaker(clock, 3, 2000, 60000, 42);
+    breaker.failure();
+    breaker.failure();
+    TEST_ASSERT_EQUAL(BREAKER_CLOSED, breaker.getState());
+    breaker.failure();
+    TEST_ASSERT_EQUAL(BREAKER_OPEN, breaker.getState());
+    BreakerStatus status = breaker.getStatus();
+    TEST_ASSERT_TRUE(status.retryInMs >= 1000 && status.retryInMs <= 2000);
+    TEST_ASSERT_FALSE(breaker.allow());
+    clock.delay(status.retryInMs);
+    TEST_ASSERT_TRUE(breaker.allow());
+    TEST_ASSERT_EQUAL(BREAKER_HALF_OPEN, breaker.getState());
+
+    // A failed retry doubles the backoff, the first success closes the breaker.
+    breaker.failure();
+    status = breaker.getStatus();
+    TEST_ASSERT_EQUAL(BREAKER_OPEN, status.state);
+    TEST_ASSERT_TRUE(status.retryInMs >= 2000 && status.retryInMs <= 4000);
+    clock.delay(status.retryInMs);
+    TEST_ASSERT_TRUE(breaker.allow());
+    breaker.success();
+    TEST_ASSERT_EQUAL(BREAKER_CLOSED, breaker.getState());
+    TEST_ASSERT_EQUAL(0, breaker.getStatus().failures);
+
+    // A SmartEVSE that is down gets probed, not sent requests that wait out a timeout.
+    FakeHttpClient http;
+    http.reachable.push_back("http://10.0.0.9");
+    FakeDiscovery discovery;
+    EvseClient client(http);
+    EvsePoller poller(client, clock, discovery);
+    poller.setTarget(target("SmartEVSE-1", "10.0.0.7"));
+    for (int i = 0; i < 3; i++) {
+        poller.poll();
+        clock.delay(10000);
+    }
+    TEST_ASSERT_EQUAL(6, http.requests.size());
+    TEST_ASSERT_TRUE(poller.consumeSnapshot());
+    TEST_ASSERT_EQUAL(BREAKER_OPEN, poller.snapshot().breaker);
+    TEST_ASSERT_EQUAL(BREAKER_OPEN, poller.getLcdBreakerStatus().state);
+
+    // Each backoff ends with a probe per endpoint.
+    http.requests.clear();
+    poller.poll();
+    TEST_ASSERT_EQUAL(2, http.probes);
+    poller.poll();
+    TEST_ASSERT_EQUAL(2, http.probes);
+    clock.delay(60000);
+    poller.poll();
+    TEST_ASSERT_EQUAL(0, http.requests.size());
+    TEST_ASSERT_EQUAL(4, http.probes);
+
+    // It is back.
+    http.reachable.clear();
+    http.responses["http://10.0.0.7:80/settings"] = {200, SETTINGS_JSON};
+    http.responses["http://10.0.0.7:80/lcd"] = {200, makeBmp(LCD_WIDTH, LCD_HEIGHT, rowNumber)};
+    clock.delay(60000);
+    poller.poll();
+    TEST_ASSERT_EQUAL(6, http.probes);
+    TEST_ASSERT_EQUAL(2, http.requests.size());
+    TEST_ASSERT_TRUE(poller.consumeSnapshot());
+    TEST_ASSERT_TRUE(poller.snapshot().connected);
+    TEST_ASSERT_EQUAL(BREAKER_CLOSED, poller.snapshot().breaker);
+}
+
+void test_evse_fleet_polls_units_independently_and_sums_them(void) {
+    // The list as saved in Preferences.
+    EvseTarget targets[EVSE_MAX_UNITS];
+    TEST_ASSERT_EQUAL(3, parseTargetList("SmartEVSE-1@10.0.0.7:80,SmartEVSE-2@:8080,,SmartEVSE-3", targets,
+                                         EVSE_MAX_UNITS));
+    TEST_ASSERT_EQUAL_STRING("10.0.0.7", targets[0].ip);
+    TEST_ASSERT_EQUAL_STRING("", targets[1].ip);
+    TEST_ASSERT_EQUAL(8080, targets[1].port);
+    TEST_ASSERT_EQUAL_STRING("SmartEVSE-3", targets[2].host);
+    char list[EVSE_TARGET_LIST_LEN];
+    formatTargetList(targets, 3, list, sizeof(list));
+    TEST_ASSERT_EQUAL_STRING("SmartEVSE-1@10.0.0.7:80,SmartEVSE-2@:8080,SmartEVSE-3@:80", list);
+
+    // Every unit has its own client, the third one does not answer.
+    FakeHttpClient http[EVSE_MAX_UNITS];
+    http[0].responses["http://10.0.0.7:80/settings"] = {200, SETTINGS_JSON};
+    http[1].responses["http://SmartEVSE-2.local/settings"] = {200, SETTINGS_JSON};
+    FakeClock clock;
+    FakeDiscovery discovery;
+    EvseClient clients[EVSE_MAX_UNITS] = {EvseClient(http[0]), EvseClient(http[1]), EvseClient(http[2]),
+                                          EvseClient(http[3])};
+    EvsePoller pollers[EVSE_MAX_UNITS] = {{clients[0], clock, discovery}, {clients[1], clock, discovery},
+                                          {clients[2], clock, discovery}, {clients[3], clock, discovery}};
+    EvsePoller *const pollerList[EVSE_MAX_UNITS] = {&pollers[0], &pollers[1], &pollers[2], &pollers[3]};
+    EvseFleet fleet(pollerList);
+    fleet.setTargets(targets, 3);
+    TEST_ASSERT_TRUE(fleet.isActive(2));
+    TEST_ASSERT_FALSE(fleet.isActive(3));
+
+    for (size_t i = 0; i < EVSE_MAX_UNITS; i++) {
+        if (fleet.isActive(i)) {
+            pollers[i].poll();
+        }
+    }
+    TEST_ASSERT_EQUAL(0, http[3].requests.size());
+    TEST_ASSERT_EQUAL(0x7, fleet.consumeSnapshots());
+    const FleetTotals totals = fleet.totals();
+    TEST_ASSERT_EQUAL(3, totals.units);
+    TEST_ASSERT_EQUAL(2, totals.connected);
+    TEST_ASSERT_EQUAL(2 * 160, totals.chargeCurrent);
+    TEST_ASSERT_EQUAL(2 * 123, totals.gridCurrent);
+
+    // Swiping wraps around the units.
+    TEST_ASSERT_TRUE(fleet.swipe(-1));
+    TEST_ASSERT_EQUAL(2, fleet.getCurrent());
+    TEST_ASSERT_FALSE(fleet.currentPoller().snapshot().connected);
+    TEST_ASSERT_TRUE(fleet.swipe(1));
+    TEST_ASSERT_EQUAL(0, fleet.getCurrent());
+    fleet.setTargets(targets, 1);
+    TEST_ASSERT_FALSE(fleet.swipe(1));
+}
+
+void test_fleet_totals_keep_sign_below_one_ampere(void) {
+    char line[48];
+    // Exporting 0.5 A.
+    formatFleetTotals({3, 3, 320, -5}, 1, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("2/3 Grid -0.5A Chg 32.0A", line);
+    formatFleetTotals({2, 1, 0, -123}, 0, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("1/2 Grid -12.3A Chg 0.0A", line);
+}
+
+void test_settings_cache_keeps_polled_body_and_shares_refresh(void) {
+    FakeHttpClient http;
+    http.responses["http://SmartEVSE-1.local/settings"] = {200, SETTINGS_JSON};
+    FakeClock clock;
+    FakeDiscovery discovery;
+    SettingsCache cache(clock);
+    EvseClient client(http, &cache);
+    EvsePoller poller(client, clock, discovery);
+    TEST_ASSERT_EQUAL(UINT32_MAX, cache.getAge());
+
+    // The poller's own fetch fills the cache with the complete body, not just the parsed fields.
+    poller.setTarget(target("SmartEVSE-1"));
+    poller.poll();
+    std::string body;
+    std::string etag;
+    TEST_ASSERT_TRUE(cache.read([&](const char *data, const size_t length, const char *tag, uint32_t) {
+        body.assign(data, length);
+        etag = tag;
+    }));
+    TEST_ASSERT_EQUAL_STRING(SETTINGS_JSON, body.c_str());
+    TEST_ASSERT_EQUAL(10, etag.size());
+    TEST_ASSERT_EQUAL(1, cache.getVersion());
+    clock.delay(400);
+    TEST_ASSERT_EQUAL(400, cache.getAge());
+
+    // Any number of requests before the next poll cost one fetch.
+    http.requests.clear();
+    poller.requestSettings();
+    poller.requestSettings();
+    poller.poll();
+    poller.poll();
+    TEST_ASSERT_EQUAL(1, http.requests.size());
+    TEST_ASSERT_EQUAL(2, cache.getVersion());
+    TEST_ASSERT_TRUE(cache.read([&](const char *, size_t, const char *tag, uint32_t) {
+        TEST_ASSERT_EQUAL_STRING(etag.c_str(), tag);
+    }));
+
+    // A body that is still being sent is not overwritten, the fetch after the next one is not cached.
+    TEST_ASSERT_TRUE(cache.read([&](const char *, size_t, const char *, uint32_t) {
+        poller.requestSettings();
+        poller.poll();
+        TEST_ASSERT_EQUAL(3, cache.getVersion());
+        poller.requestSettings();
+        poller.poll();
+        TEST_ASSERT_EQUAL(3, cache.getVersion());
+    }));
+    poller.requestSettings();
+    poller.poll();
+    TEST_ASSERT_EQUAL(4, cache.getVersion());
+
+    // A body that does not parse is not cached.
+    http.responses["http://SmartEVSE-1.local/settings"] = {200, "{\"mode_id\":"};
+    poller.requestSettings();
+    poller.poll();
+    TEST_ASSERT_EQUAL(4, cache.getVersion());
+}
+
+void test_poll_scheduler_adapts_pace_and_reports_rates(void) {
+    FakeClock clock;
+    PollRates rates = DEFAULT_POLL_RATES;
+    TEST_ASSERT_FALSE(parsePollRates("250,1000,4000,1000,3000", rates));
+    TEST_ASSERT_TRUE(parsePollRates("250,1000,4000,1000,3000,20000", rates));
+    TEST_ASSERT_EQUAL(4000, rates.lcdIdle);
+    PollScheduler scheduler(clock, rates);
+
+    // Everything is due at the start, then the normal pace.
+    TEST_ASSERT_TRUE(scheduler.lcdDue());
+    TEST_ASSERT_TRUE(scheduler.settingsDue());
+    scheduler.lcdFetched(true, false);
+    scheduler.settingsFetched(true, false);
+    TEST_ASSERT_EQUAL(POLL_PACE_NORMAL, scheduler.getPace());
+    clock.delay(999);
+    TEST_ASSERT_FALSE(scheduler.lcdDue());
+    clock.delay(1);
+    TEST_ASSERT_TRUE(scheduler.lcdDue());
+
+    // A changed frame speeds up for a while.
+    scheduler.lcdFetched(true, true);
+    clock.delay(250);
+    TEST_ASSERT_EQUAL(POLL_PACE_FAST, scheduler.getPace());
+    TEST_ASSERT_TRUE(scheduler.lcdDue());
+    clock.delay(10000);
+    TEST_ASSERT_EQUAL(POLL_PACE_NORMAL, scheduler.getPace());
+
+    // Charging keeps it fast, a SmartEVSE that does not answer slows it down.
+    scheduler.settingsFetched(true, true);
+    TEST_ASSERT_EQUAL(POLL_PACE_FAST, scheduler.getPace());
+    scheduler.settingsFetched(false, false);
+    scheduler.lcdFetched(false, false);
+    TEST_ASSERT_EQUAL(POLL_PACE_IDLE, scheduler.getPace());
+    clock.delay(3999);
+    TEST_ASSERT_FALSE(scheduler.lcdDue());
+    // Until the mode is changed here.
+    scheduler.boost();
+    TEST_ASSERT_EQUAL(POLL_PACE_FAST, scheduler.getPace());
+    TEST_ASSERT_TRUE(scheduler.lcdDue());
+
+    // Without changes for a minute it is idle, the rates are per second over the last window.
+    scheduler.lcdFetched(true, false);
+    clock.delay(60000);
+    TEST_ASSERT_EQUAL(POLL_PACE_IDLE, scheduler.getPace());
+    scheduler.lcdFetched(true, false);
+    const PollStats stats = scheduler.getStats();
+    TEST_ASSERT_EQUAL(POLL_PACE_IDLE, stats.pace);
+    TEST_ASSERT_EQUAL_FLOAT(0, stats.framesPerSecond);
+    TEST_ASSERT_TRUE(stats.lcdRequestsPerSecond > 0 && stats.lcdRequestsPerSecond < 0.1f);
+
+    // Without requests, as while a breaker is open, the rates drop to 0 once a window passed.
+    clock.delay(20000);
+    TEST_ASSERT_EQUAL_FLOAT(0, scheduler.getStats().lcdRequestsPerSecond);
+}
+
+void test_poller_uses_cached_address_and_resolves_after_failure(void) {
+    FakeHttpClient http;
+    http.responses["http://10.0.0.7:80/settings"] = {200, SETTINGS_JSON};
+    http.responses["http://10.0.0.7:80/lcd"] = {200, makeBmp(LCD_WIDTH, LCD_HEIGHT, rowNumber)};
+    FakeClock clock;
+    FakeDiscovery discovery;
+    discovery.addresses["SmartEVSE-1"] = "10.0.0.7";
+    EvseClient client(http);
+    EvsePoller poller(client, clock, discovery);
+
+    // The cached address answers, no lookup.
+    poller.setTarget(target("SmartEVSE-1", "10.0.0.7"));
+    poller.poll();
+    TEST_ASSERT_EQUAL_STRING("GET http://10.0.0.7:80/lcd", http.requests[0].c_str());
+    TEST_ASSERT_EQUAL(0, discovery.resolved.size());
+    TEST_ASSERT_FALSE(poller.consumeResolvedTarget());
+
+    // The SmartEVSE got a new address, a single host lookup finds it.
+    poller.setTarget(target("SmartEVSE-1", "10.0.0.3"));
+    poller.poll();
+    TEST_ASSERT_EQUAL(1, discovery.resolved.size());
+    TEST_ASSERT_EQUAL_STRING("SmartEVSE-1", discovery.resolved[0].c_str());
+    TEST_ASSERT_TRUE(poller.consumeResolvedTarget());
+    TEST_ASSERT_EQUAL_STRING("10.0.0.7", poller.resolvedTarget().ip);
+    TEST_ASSERT_TRUE(poller.consumeSnapshot());
+    TEST_ASSERT_TRUE(poller.snapshot().connected);
+}
+
+void test_mdns_browser_shares_browse_and_reports_hosts_per_round(void) {
+    FakeDiscovery discovery;
+    FakeClock clock;
+    MdnsBrowser browser(discovery, clock, "SmartEVSE-");
+    hal::DiscoveredHost hosts[MDNS_BROWSER_MAX_HOSTS];
+    TEST_ASSERT_FALSE(browser.step());
+
+    discovery.hosts.push_back(discoveredHost("SmartEVSE-1", "10.0.0.7"));
+    discovery.hosts.push_back(discoveredHost("printer", "10.0.0.9"));
+    browser.request();
+    browser.request(true);
+    TEST_ASSERT_TRUE(browser.isBrowsing());
+    TEST_ASSERT_TRUE(browser.step());
+    TEST_ASSERT_EQUAL(1, browser.getHosts(hosts, MDNS_BROWSER_MAX_HOSTS));
+    TEST_ASSERT_EQUAL_STRING("10.0.0.7", hosts[0].ip);
+
+    // A second device answers in a later round, a request meanwhile joins the running browse.
+    discovery.hosts.push_back(discoveredHost("SmartEVSE-2", "10.0.0.8"));
+    const uint32_t version = browser.getVersion();
+    browser.request(true);
+    TEST_ASSERT_TRUE(browser.step());
+    TEST_ASSERT_NOT_EQUAL(version, browser.getVersion());
+    TEST_ASSERT_EQUAL(2, browser.getHosts(hosts, MDNS_BROWSER_MAX_HOSTS));
+
+    int rounds = 2;
+    while (browser.step()) {
+        rounds++;
+    }
+    TEST_ASSERT_EQUAL(rounds, discovery.browses);
+    TEST_ASSERT_FALSE(browser.isBrowsing());
+
+    // Recent results are reused, a forced browse drops the devices that went away.
+    browser.request();
+    TEST_ASSERT_FALSE(browser.step());
+    discovery.hosts.erase(discovery.hosts.begin());
+    browser.request(true);
+    while (browser.step()) {
+    }
+    TEST_ASSERT_EQUAL(1, browser.getHosts(hosts, MDNS_BROWSER_MAX_HOSTS));
+    TEST_ASSERT_EQUAL_STRING("SmartEVSE-2", hosts[0].host);
+}
+
+void test_event_stream_sends_changed_state_to_all_clients(void) {
+    socketOutput.clear();
+    failingSocket = -1;
+    EventStream stream(sendToSocket);
+    EvseSnapshot state = {true, EVSE_MODE_SMART, "Charging", 160, 123, EVSE_ERROR_NONE, BREAKER_CLOSED};
+
+    TEST_ASSERT_TRUE(stream.publish(state, true));
+    TEST_ASSERT_TRUE(stream.subscribe(7));
+    TEST_ASSERT_EQUAL(0, socketOutput[7].find("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, socketOutput[7].find("event: status\ndata: {"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, socketOutput[7].find(R"("evseState":"Charging")"));
+    TEST_ASSERT_EQUAL('\n', socketOutput[7].back());
+
+    // An unchanged state is not sent again.
+    TEST_ASSERT_TRUE(stream.subscribe(8));
+    socketOutput.clear();
+    TEST_ASSERT_FALSE(stream.publish(state, true));
+    stream.flush();
+    TEST_ASSERT_EQUAL(0, socketOutput.size());
+
+    // A client that fails is dropped, the others get the change.
+    state.evseState = internEvseState("Say \"hi\"");
+    failingSocket = 8;
+    TEST_ASSERT_TRUE(stream.publish(state, true));
+    stream.flush();
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, socketOutput[7].find(R"("evseState":"Say \"hi\"")"));
+    TEST_ASSERT_EQUAL(1, stream.getClientCount());
+
+    stream.unsubscribe(7);
+    TEST_ASSERT_EQUAL(0, stream.getClientCount());
+}
+
+void test_lcd_stream_answers_long_polls_with_the_next_frame(void) {
+    socketOutput.clear();
+    failingSocket = -1;
+    FakeClock clock;
+    LcdStream stream(sendToSocket, clock, 20000);
+    LcdFrame frame = {true, {}};
+    frame.pixels[0][0] = 0x80;
+    frame.pixels[63][15] = 0x01;
+
+    // Nothing yet: the request waits for the first frame.
+    TEST_ASSERT_TRUE(stream.request(5, LCD_FORMAT_BMP, 0));
+    TEST_ASSERT_EQUAL(0, socketOutput.size());
+    TEST_ASSERT_TRUE(stream.publish(frame));
+    stream.flush();
+    TEST_ASSERT_EQUAL(0, stream.getWaiterCount());
+    const std::string &response = socketOutput[5];
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 200 OK\r\nContent-Type: image/bmp\r\n"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, response.find("X-Frame-Sequence: 1\r\n"));
+
+    // The BMP decodes to the same frame.
+    MemoryStream bmp;
+    bmp.data = response.substr(response.find("\r\n\r\n") + 4);
+    TEST_ASSERT_EQUAL(LCD_BMP_SIZE, bmp.data.size());
+    BmpInfo info;
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpHeader(bmp, info));
+    LcdFrame decoded = {true, {}};
+    TEST_ASSERT_EQUAL(BMP_OK, readBmpRows(bmp, info, [&decoded](const int y, const uint8_t *row) {
+        memcpy(decoded.pixels[y], row, LCD_BYTES_PER_ROW);
+    }));
+    TEST_ASSERT_EQUAL_MEMORY(frame.pixels, decoded.pixels, sizeof(frame.pixels));
+
+    // An unchanged frame keeps its number, a client that has it waits, and times out.
+    TEST_ASSERT_FALSE(stream.publish(frame));
+    TEST_ASSERT_TRUE(stream.request(6, LCD_FORMAT_RLE, 1));
+    clock.delay(19999);
+    stream.flush();
+    TEST_ASSERT_EQUAL(0, socketOutput.count(6));
+    clock.delay(1);
+    stream.flush();
+    TEST_ASSERT_EQUAL(0, socketOutput[6].find("HTTP/1.1 204 No Content\r\n"));
+
+    // A changed frame, run-length encoded: 1 byte 0x80, 1022 zero bytes, 1 byte 0x01.
+    frame.pixels[0][0] = 0xc0;
+    TEST_ASSERT_TRUE(stream.publish(frame));
+    socketOutput.clear();
+    TEST_ASSERT_TRUE(stream.request(6, LCD_FORMAT_RLE, 1));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, socketOutput[6].find("X-Frame-Sequence: 2\r\n"));
+    uint8_t rle[LCD_RLE_MAX_SIZE];
+    const uint8_t expected[] = {1, 0xc0, 255, 0, 255, 0, 255, 0, 255, 0, 2, 0, 1, 0x01};
+    TEST_ASSERT_EQUAL(sizeof(expected), encodeLcdRle(frame, rle));
+    TEST_ASSERT_EQUAL_MEMORY(expected, rle, sizeof(expected));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_triple_buffer_hands_over_latest_value);
+    RUN_TEST(test_spsc_ring_drops_oldest_and_counts_stages);
+    RUN_TEST(test_bmp_decoder_reads_chunked_bottom_up_bitmap);
+    RUN_TEST(test_bmp_decoder_normalizes_top_down_rows_whatever_the_palette);
+    RUN_TEST(test_bmp_decoder_keeps_set_bits_lit_in_smartevse_bitmap);
+    RUN_TEST(test_bmp_decoder_rejects_truncated_and_foreign_data);
+    RUN_TEST(test_evse_client_parses_settings);
+    RUN_TEST(test_evse_client_reports_unreachable_host);
+    RUN_TEST(test_evse_client_fetches_lcd);
+    RUN_TEST(test_json_arena_reuses_buffer_and_interns_states);
+    RUN_TEST(test_lcd_mirror_draws_doubled_frame_and_skips_unchanged_rows);
+    RUN_TEST(test_compositor_pushes_only_changed_widgets);
+    RUN_TEST(test_mono_blitter_expands_bits_in_order_and_scale);
+    RUN_TEST(test_mdns_browser_shares_browse_and_reports_hosts_per_round);
+    RUN_TEST(test_event_stream_sends_changed_state_to_all_clients);
+    RUN_TEST(test_lcd_stream_answers_long_polls_with_the_next_frame);
+    RUN_TEST(test_poller_publishes_state_and_changes_mode);
+    RUN_TEST(test_poller_uses_cached_address_and_resolves_after_failure);
+    RUN_TEST(test_poll_scheduler_adapts_pace_and_reports_rates);
+    RUN_TEST(test_circuit_breaker_backs_off_and_probes_before_retrying);
+    RUN_TEST(test_latency_histogram_counts_buckets_and_percentiles);
+    RUN_TEST(test_metrics_time_stages_and_export_prometheus_text);
+    RUN_TEST(test_evse_fleet_polls_units_independently_and_sums_them);
+    RUN_TEST(test_fleet_totals_keep_sign_below_one_ampere);
+    RUN_TEST(test_settings_cache_keeps_polled_body_and_shares_refresh);
+    return UNITY_END();
+}